@@ -0,0 +1,494 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <nlohmann/json.hpp>
+#include <spawn.h>
+#include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+#include <zip.h>
+
+#include "Arena.h"
+#include "AsyncLogger.h"
+#include "Patcher.h"
+#include "TaskGraph.h"
+#include "mods/Mod.h"
+#include "spdlog/fmt/bundled/format.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+using json   = nlohmann::json;
+
+namespace {
+atomic<uint64_t> heapAllocations = 0;
+
+uint64_t median(vector<uint64_t> values) {
+  const auto middle = values.begin() + values.size() / 2;
+  ranges::nth_element(values, middle);
+  return *middle;
+}
+
+string entryName(size_t index) {
+  return fmt::format("properties/resupply_{}.inc", index);
+}
+
+string scalingEntryName(size_t index) {
+  return fmt::format("scaling/resupply_{}.inc", index);
+}
+
+/**
+ * @brief Run a program and wait for it, its output is discarded
+ * @throw std::runtime_error If the program cannot be started or fails
+ */
+void runProcess(const fs::path& executable, vector<string> arguments) noexcept(false) {
+  string path = executable.string();
+  vector<char*> argv{path.data()};
+  for (auto& argument : arguments) {
+    argv.push_back(argument.data());
+  }
+  argv.push_back(nullptr);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+  pid_t pid;
+  const int error = posix_spawn(&pid, path.c_str(), &actions, nullptr, argv.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (error != 0) {
+    throw runtime_error("cannot start " + path + ": " + strerror(error));
+  }
+
+  int status;
+  if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    throw runtime_error(path + " failed");
+  }
+}
+
+json loadBaseline(const fs::path& file) noexcept(false) {
+  ifstream in(file);
+  if (!in) {
+    throw runtime_error("cannot open baseline " + file.string());
+  }
+  try {
+    return json::parse(in);
+  } catch (const json::exception& e) {
+    throw runtime_error("invalid baseline " + file.string() + ": " + e.what());
+  }
+}
+}  // namespace
+
+// count heap allocations of the whole program, only the performance check replaces the allocator
+void* operator new(size_t size) {
+  heapAllocations.fetch_add(1, memory_order_relaxed);
+  if (void* p = malloc(size != 0 ? size : 1)) {
+    return p;
+  }
+  throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+Benchmark::Benchmark(std::filesystem::path workDir, unsigned iterations)
+    : m_workDir(std::move(workDir)), m_fixturePath(m_workDir / "fixtures"),
+      m_gamePath(m_workDir / "game"), m_outputPath(m_workDir / "out"),
+      m_firstRunPath(m_workDir / "first-run"), m_iterations(max(iterations, 1u)) {}
+
+template <typename Prepare, typename F>
+Benchmark::result_t Benchmark::measure(Prepare&& prepare, F&& f) const {
+  vector<uint64_t> times;
+  vector<uint64_t> allocations;
+  vector<uint64_t> allocationsWithoutArena;
+  for (unsigned i = 0; i < m_iterations; i++) {
+    prepare();
+
+    const Arena::statistics_t arenaBefore = Arena::totals();
+    const uint64_t allocationsBefore      = heapAllocations.load(memory_order_relaxed);
+    const auto start                      = chrono::steady_clock::now();
+    f();
+    const auto end = chrono::steady_clock::now();
+
+    const uint64_t heap = heapAllocations.load(memory_order_relaxed) - allocationsBefore;
+
+    // every allocation served by an arena would have been a heap allocation of its own
+    const Arena::statistics_t arena = Arena::totals();
+    const uint64_t served           = arena.allocations - arenaBefore.allocations;
+    const uint64_t upstream         = arena.upstreamAllocations - arenaBefore.upstreamAllocations;
+
+    times.push_back((end - start) / 1us);
+    allocations.push_back(heap);
+    allocationsWithoutArena.push_back(heap + served - upstream);
+  }
+  return {median(std::move(times)), median(std::move(allocations)),
+          median(std::move(allocationsWithoutArena))};
+}
+
+Benchmark::results_t Benchmark::run() const noexcept(false) {
+  writeFixtures();
+
+  // start with an empty output directory, the patcher records the checksums of its contents
+  fs::remove_all(m_outputPath);
+  fs::create_directories(m_outputPath);
+  Patcher patcher(m_outputPath, m_gamePath, 0);
+
+  map<string, vector<string>> archives;
+  for (size_t i = 0; i < fileCount; i++) {
+    archives["properties.pak"].push_back(entryName(i));
+  }
+  const ModData modData("benchmark", "", archives, {});
+  const Mod& mod = modData.mod();
+
+  results_t results;
+
+  vector<Patcher::fileData_t> files;
+  for (size_t i = 0; i < fileCount; i++) {
+    files.push_back(Patcher::loadFromFile(fixture(i)));
+  }
+  const auto patchFiles = [&] {
+    for (const auto& data : files) {
+      Patcher::patch(data.view(), Settings{});
+    }
+  };
+  results["patch"] = measure([] {}, patchFiles);
+
+  // verbose runs log on a background thread, the messages are written to a file here. The traces
+  // of the patched lines are only compiled in with RESUPPLY_PATCHER_LOG_LEVEL=TRACE.
+  vector levels = {spdlog::level::info, spdlog::level::debug};
+  if constexpr (SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE) {
+    levels.push_back(spdlog::level::trace);
+  }
+  const fs::path logFile = m_workDir / "benchmark.log";
+  for (const auto level : levels) {
+    AsyncLogger logger(make_shared<spdlog::sinks::basic_file_sink_mt>(logFile.string(), true),
+                       level);
+    results[fmt::format("patch log {}", spdlog::level::to_string_view(level))] =
+        measure([] {}, patchFiles);
+  }
+
+  const fs::path archive = m_gamePath / "resource/properties.pak";
+  results["extract"]     = measure(
+      [] {},
+      [&] {
+        for (size_t i = 0; i < fileCount; i++) {
+          patcher.loadFromArchive(archive, entryName(i));
+        }
+      });
+
+  // all entries of one archive, extracted by concurrent tasks
+  const fs::path scalingArchive  = m_gamePath / "resource/scaling.pak";
+  const auto extractConcurrently = [&](unsigned jobs, bool libzip) {
+    TaskGraph graph;
+    for (size_t i = 0; i < scalingEntryCount; i++) {
+      graph.add(scalingEntryName(i), [&, i, libzip] {
+        if (libzip) {
+          patcher.loadWithLibzip(scalingArchive, scalingEntryName(i));
+        } else {
+          patcher.loadFromArchive(scalingArchive, scalingEntryName(i));
+        }
+      });
+    }
+    graph.run(jobs);
+  };
+  for (const unsigned jobs : threadCounts) {
+    results[fmt::format("extract {} threads", jobs)] = measure(
+        [] {},
+        [&] {
+          extractConcurrently(jobs, false);
+        });
+    results[fmt::format("libzip {} threads", jobs)] = measure(
+        [] {},
+        [&] {
+          extractConcurrently(jobs, true);
+        });
+  }
+
+  results["generateItemsAll"] = measure(
+      [&] {
+        resetOutput();
+      },
+      [&] {
+        TaskGraph graph;
+        patcher.generateItemsAll(graph, mod, {});
+        graph.run(1);
+      });
+
+  results["replaceResupply"] = measure(
+      [&] {
+        resetOutput();
+      },
+      [&] {
+        TaskGraph graph;
+        patcher.replaceResupply(graph, mod, {});
+        graph.run(1);
+      });
+
+  results["checksum scan"] = measure(
+      [] {},
+      [&] {
+        for (size_t i = 0; i < fileCount; i++) {
+          Patcher::sha256(fixture(i));
+        }
+      });
+
+  // a new process patching the vanilla file, the allocations of the child process are not
+  // visible here
+  const fs::path executable = fs::read_symlink("/proc/self/exe");
+  results["cold start"]     = measure(
+      [&] {
+        fs::remove_all(m_firstRunPath);
+      },
+      [&] {
+        runProcess(executable, {"--first-run", m_workDir.string()});
+      });
+  results["cold start"].allocationsCounted = false;
+
+  fs::remove_all(m_outputPath);
+  fs::remove_all(m_firstRunPath);
+  fs::create_directories(m_outputPath);
+
+  return results;
+}
+
+void Benchmark::firstRun() const noexcept(false) {
+  Patcher patcher(m_firstRunPath, m_gamePath, 0);
+  TaskGraph graph;
+  patcher.patchVanilla(graph);
+  graph.run(TaskGraph::defaultJobs());
+}
+
+bool Benchmark::compare(const results_t& results,
+                        const std::filesystem::path& baselineFile) noexcept(false) {
+  const json baseline = loadBaseline(baselineFile);
+
+  const double allocationsLimit =
+      1 + baseline.value(json::json_pointer("/tolerance/allocations"), allocationsTolerance);
+
+  // the durations depend on the machine, they are only shown
+  bool passed = true;
+  cout << fmt::format("{:<18} {:>10} {:>10} {:>12} {:>12} {:>12}\n", "stage", "time [µs]",
+                      "baseline", "allocations", "baseline", "no arenas");
+  for (const auto& [stage, result] : results) {
+    const json* expected = nullptr;
+    if (baseline.contains("stages") && baseline["stages"].contains(stage)) {
+      expected = &baseline["stages"][stage];
+    }
+
+    // a stage without a baseline value could never fail
+    if (expected == nullptr) {
+      passed = false;
+      cout << fmt::format("{:<18} {:>10} {:>10} {:>12} {:>12} {:>12}  MISSING BASELINE\n", stage,
+                          result.time, "-", result.allocations, "-",
+                          result.allocationsWithoutArena);
+      continue;
+    }
+
+    const auto expectedTime = expected->value("time", uint64_t{0});
+
+    // stages without allocations in the baseline are not checked, e.g. the cold start
+    string allocations         = "-";
+    string expectedAllocations = "-";
+    string status;
+    if (result.allocationsCounted) {
+      allocations = to_string(result.allocations);
+    }
+    if (result.allocationsCounted && expected->contains("allocations")) {
+      const auto limit    = (*expected)["allocations"].get<uint64_t>();
+      expectedAllocations = to_string(limit);
+      if (static_cast<double>(result.allocations) >
+          static_cast<double>(limit) * allocationsLimit) {
+        passed = false;
+        status = " REGRESSION: more allocations";
+      }
+    }
+
+    cout << fmt::format("{:<18} {:>10} {:>10} {:>12} {:>12} {:>12}{}\n", stage, result.time,
+                        expectedTime, allocations, expectedAllocations,
+                        result.allocationsWithoutArena, status);
+  }
+
+  // durations relative to another stage of the same run hardly depend on the machine
+  if (!baseline.contains("ratios")) {
+    return passed;
+  }
+  cout << fmt::format("\n{:<18} {:<18} {:>8} {:>8}\n", "stage", "relative to", "ratio", "limit");
+  for (const auto& [stage, limit] : baseline["ratios"].items()) {
+    const string reference = limit.value("reference", "");
+    const auto result      = results.find(stage);
+    const auto base        = results.find(reference);
+    // e.g. the trace logging stage, which is only measured if the traces are compiled in
+    if (result == results.end() || base == results.end()) {
+      cout << fmt::format("{:<18} {:<18} {:>8} {:>8}  not measured\n", stage, reference, "-",
+                          "-");
+      continue;
+    }
+    // a speedup over fewer threads can only be expected with enough cores
+    const unsigned threads = limit.value("threads", 1u);
+    if (threads > thread::hardware_concurrency()) {
+      cout << fmt::format("{:<18} {:<18} {:>8} {:>8}  skipped, needs {} hardware threads\n",
+                          stage, reference, "-", "-", threads);
+      continue;
+    }
+
+    const auto baseTime   = static_cast<double>(max<uint64_t>(base->second.time, 1));
+    const double ratio    = static_cast<double>(result->second.time) / baseTime;
+    const double maxRatio = limit.value("max", 1.0);
+    string status;
+    if (ratio > maxRatio) {
+      passed = false;
+      status = " REGRESSION: slower";
+    }
+    cout << fmt::format("{:<18} {:<18} {:>8.2f} {:>8.2f}{}\n", stage, reference, ratio, maxRatio,
+                        status);
+  }
+
+  return passed;
+}
+
+void Benchmark::saveBaseline(const results_t& results,
+                             const std::filesystem::path& baselineFile) noexcept(false) {
+  json baseline;
+  if (fs::exists(baselineFile)) {
+    baseline = loadBaseline(baselineFile);
+  } else {
+    baseline["tolerance"] = {
+        {"allocations", allocationsTolerance},
+    };
+  }
+
+  json& stages = baseline["stages"];
+  stages       = json::object();
+  for (const auto& [stage, result] : results) {
+    stages[stage] = {
+        {"time", result.time},
+    };
+    if (result.allocationsCounted) {
+      stages[stage]["allocations"] = result.allocations;
+    }
+  }
+
+  ofstream out(baselineFile);
+  out.exceptions(ios::failbit | ios::badbit);
+  out << baseline.dump(2) << "\n";
+}
+
+std::string Benchmark::generateFile(size_t index) {
+  string result;
+
+  for (size_t block = 0; block < blockCount; block++) {
+    for (const char* category : {"light", "heavy", "medic"}) {
+      result += fmt::format("(define \"items_{}_{}\"\r\n", category, block % 8);
+      result += fmt::format("\t{{item \"{}_{}\" \"ammo\" {} {{value {}}}}}\r\n", category,
+                            (block + index) % 23, block % 5, 5 + block % 10);
+      result += "\t(\"mp\")\r\n";
+      result += fmt::format("\t{{item \"{}_special_{}\" {} {{value {}}}}}\r\n", category,
+                            block % 17, block % 3, 20 + block % 30);
+      result += ")\r\n\r\n";
+    }
+
+    result += "{resupply\r\n";
+    result += fmt::format("\t{{radius {}}}\r\n", 10 + block % 20);
+    result += fmt::format("\t{{resupplyPeriod {}}}\r\n", 5 + block % 10);
+    result += fmt::format("\t{{regenerationPeriod {}}}\r\n", 1 + block % 4);
+    result += block % 4 == 0 ? "\t{limit %supply}\r\n" : fmt::format("\t{{limit {}}}\r\n", block);
+    result += fmt::format("\t(\"items_light_{}\")\r\n", block % 8);
+    result += fmt::format("\t(\"items_heavy_{}\")\r\n", (block + 1) % 8);
+    result += "\t(\"items_medic\")\r\n";
+    // some blocks end with a reference on the line of the closing brace
+    if (block % 5 == 1) {
+      result += "\t(\"items_light_sniper\")\t}\r\n\r\n";
+    } else {
+      result += "\t(\"items_light_sniper\")\r\n";
+      result += "\r\n";
+      result += "\t}\r\n\r\n";
+    }
+  }
+
+  result += "(define \"items_engineer\"\r\n\t{item \"mine\" 1 {value 10}}\r\n)\r\n\r\n";
+  result += "(define \"items_explosives\"\r\n\t{item \"tnt\" 1 {value 20}}\r\n)\r\n\r\n";
+
+  return result;
+}
+
+void Benchmark::writeFixtures() const noexcept(false) {
+  fs::create_directories(m_fixturePath / "properties");
+  fs::create_directories(m_gamePath / "resource");
+
+  map<string, string> entries;
+  for (size_t i = 0; i < fileCount; i++) {
+    const string& content = entries[entryName(i)] = generateFile(i);
+
+    ofstream out(fixture(i), ios::binary);
+    out.exceptions(ios::failbit | ios::badbit);
+    out.write(content.data(), static_cast<streamsize>(content.size()));
+  }
+  // patched by firstRun()
+  entries["properties/resupply.inc"] = generateFile(fileCount);
+  writeArchive(m_gamePath / "resource/properties.pak", entries);
+
+  entries.clear();
+  for (size_t i = 0; i < scalingEntryCount; i++) {
+    string& content = entries[scalingEntryName(i)];
+    for (size_t j = 0; j < scalingRepeat; j++) {
+      content += generateFile(i * scalingRepeat + j);
+    }
+  }
+  writeArchive(m_gamePath / "resource/scaling.pak", entries);
+}
+
+void Benchmark::writeArchive(const std::filesystem::path& archive,
+                             const std::map<std::string, std::string>& entries) noexcept(false) {
+  // the archive keeps references to the data until it is closed
+  int err;
+  zip_t* z = zip_open(archive.c_str(), ZIP_CREATE | ZIP_TRUNCATE, &err);
+  if (z == nullptr) {
+    throw runtime_error("error creating archive " + archive.string());
+  }
+
+  for (const auto& [name, content] : entries) {
+    zip_source_t* source = zip_source_buffer(z, content.data(), content.size(), 0);
+    if (source == nullptr || zip_file_add(z, name.c_str(), source, ZIP_FL_OVERWRITE) < 0) {
+      zip_source_free(source);
+      const string error = zip_strerror(z);
+      zip_discard(z);
+      throw runtime_error("error adding to archive " + archive.string() + ": " + error);
+    }
+  }
+
+  if (zip_close(z) != 0) {
+    const string error = zip_strerror(z);
+    zip_discard(z);
+    throw runtime_error("error writing archive " + archive.string() + ": " + error);
+  }
+}
+
+void Benchmark::resetOutput() const noexcept(false) {
+  fs::remove_all(m_outputPath);
+  fs::create_directories(m_outputPath);
+  fs::copy(m_fixturePath, m_outputPath, fs::copy_options::recursive);
+}
+
+std::filesystem::path Benchmark::fixture(size_t index) const {
+  return m_fixturePath / entryName(index);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+
+/**
+ * @brief Measures the core patching stages on generated data and compares them to a baseline
+ *
+ * Every stage is run several times with the entry cache disabled and on a single thread. The
+ * median duration and the median number of heap allocations are reported, next to the number of
+ * heap allocations the stage would make if its arenas forwarded every allocation. The patch stage
+ * is repeated with info and debug logging, and with trace logging if the traces are compiled in.
+ * The entries of a single archive are extracted concurrently with different numbers of threads,
+ * both through the memory mapping and through libzip. The cold start is measured by starting the
+ * program again for a first patch run, see firstRun().
+ *
+ * Heap allocations are counted by replacing the global operator new, which is only done in the
+ * performance check program. Absolute durations depend on the machine, so they are only shown. The
+ * check compares the allocations and the durations of stages relative to other stages of the same
+ * run, e.g. the concurrent extraction relative to the one with a single thread. Such speedups are
+ * only checked if the machine has enough hardware threads.
+ */
+class Benchmark {
+public:
+  struct result_t {
+    uint64_t time;                     //! median duration in µs
+    uint64_t allocations;              //! median number of heap allocations
+    uint64_t allocationsWithoutArena;  //! median number of heap allocations without the arenas
+    bool allocationsCounted = true;    //! false if the stage allocates in another process
+  };
+
+  using results_t = std::map<std::string, result_t>;
+
+  /**
+   * @param workDir Directory to generate the test data in
+   * @param iterations Number of runs per stage
+   */
+  explicit Benchmark(std::filesystem::path workDir, unsigned iterations = 9);
+
+  /**
+   * @brief Run all stages
+   * @throw std::runtime_error
+   */
+  results_t run() const noexcept(false);
+
+  /**
+   * @brief Patch the vanilla file of the generated data like the first run of a new process,
+   * expects the data written by run()
+   * @throw std::runtime_error
+   */
+  void firstRun() const noexcept(false);
+
+  /**
+   * @brief Print the results next to the baseline values
+   * @param results Measured results
+   * @param baselineFile Baseline file written by saveBaseline()
+   * @return false if a stage allocates more than the baseline allows, if the duration of a stage
+   * relative to its reference stage exceeds the ratio stored in the baseline, or if a stage has no
+   * baseline value
+   * @throw std::runtime_error If the baseline file cannot be read
+   */
+  static bool compare(const results_t& results,
+                      const std::filesystem::path& baselineFile) noexcept(false);
+
+  /**
+   * @brief Replace the values stored in the baseline file, tolerances and ratios are kept
+   * @throw std::runtime_error
+   */
+  static void saveBaseline(const results_t& results,
+                           const std::filesystem::path& baselineFile) noexcept(false);
+
+private:
+  static constexpr size_t fileCount  = 16;
+  static constexpr size_t blockCount = 200;  // resupply blocks and item lists per file
+
+  // entries of the archive extracted concurrently, each one contains several generated files
+  static constexpr size_t scalingEntryCount = 64;
+  static constexpr size_t scalingRepeat     = 4;
+  static constexpr std::array threadCounts  = {1u, 2u, 4u, 8u};
+
+  // tolerance of a new baseline
+  static constexpr double allocationsTolerance = 0.05;
+
+  /**
+   * @brief Run a stage, calling prepare before every run without measuring it
+   */
+  template <typename Prepare, typename F>
+  result_t measure(Prepare&& prepare, F&& f) const;
+
+  /**
+   * @brief Generate the contents of a resupply file
+   */
+  static std::string generateFile(size_t index);
+
+  /**
+   * @brief Write the generated files, an archive containing them and a vanilla resupply file, and
+   * the archive extracted concurrently
+   * @throw std::runtime_error
+   */
+  void writeFixtures() const noexcept(false);
+
+  /**
+   * @brief Write an archive with deflated entries
+   * @param archive Archive to create
+   * @param entries Names and contents of the entries
+   * @throw std::runtime_error
+   */
+  static void writeArchive(const std::filesystem::path& archive,
+                           const std::map<std::string, std::string>& entries) noexcept(false);
+
+  /**
+   * @brief Copy the generated files into the output directory
+   */
+  void resetOutput() const noexcept(false);
+
+  std::filesystem::path fixture(size_t index) const;
+
+  std::filesystem::path m_workDir;
+  std::filesystem::path m_fixturePath;
+  std::filesystem::path m_gamePath;
+  std::filesystem::path m_outputPath;
+  std::filesystem::path m_firstRunPath;
+  unsigned m_iterations;
+};
@@ -0,0 +1,64 @@
+#include <argparse/argparse.hpp>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+
+#include "Benchmark.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv) {
+  argparse::ArgumentParser program("resupply_patcher_perf", "1.0",
+                                   argparse::default_arguments::help);
+
+  program.add_argument("-b", "--baseline")
+      .help("baseline file to compare the measurements to")
+      .metavar("BASELINE");
+
+  program.add_argument("--update-baseline")
+      .help("store the measurements in the baseline file instead of comparing them")
+      .flag();
+
+  // started by the benchmark itself to measure the cold start
+  program.add_argument("--first-run")
+      .help("patch the data generated in the work directory once and exit")
+      .flag();
+
+  program.add_argument("work_dir").help("directory to generate the test data in").required();
+
+  try {
+    program.parse_args(argc, argv);
+    if (!program.present("--baseline") && !program.get<bool>("--first-run")) {
+      throw runtime_error("--baseline: a baseline file is required");
+    }
+  } catch (const exception& err) {
+    cerr << err.what() << "\n";
+    cerr << program;
+    return 1;
+  }
+
+  spdlog::set_level(spdlog::level::err);
+
+  const Benchmark benchmark(program.get<string>("work_dir"));
+  try {
+    if (program.get<bool>("--first-run")) {
+      benchmark.firstRun();
+      return 0;
+    }
+
+    const fs::path baseline = program.get<string>("--baseline");
+    const auto results      = benchmark.run();
+    if (program.get<bool>("--update-baseline")) {
+      Benchmark::saveBaseline(results, baseline);
+      return 0;
+    }
+    return Benchmark::compare(results, baseline) ? 0 : 1;
+  } catch (const runtime_error& ex) {
+    cerr << "Error while measuring: " << ex.what() << "\n";
+    return 1;
+  }
+}
@@ -0,0 +1,259 @@
+#include "ArchiveIndex.h"
+
+#include <algorithm>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+
+#include "Parallel.h"
+#include "Timer.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+template <typename T>
+void write(ostream& out, T value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeString(ostream& out, string_view str) {
+  write(out, static_cast<uint32_t>(str.size()));
+  out.write(str.data(), static_cast<streamsize>(str.size()));
+}
+
+template <typename T>
+T read(istream& in) {
+  T value;
+  in.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return value;
+}
+
+string readString(istream& in) {
+  string str(read<uint32_t>(in), '\0');
+  in.read(str.data(), static_cast<streamsize>(str.size()));
+  return str;
+}
+}  // namespace
+
+ArchiveIndex::ArchiveIndex(std::filesystem::path indexFile) noexcept
+    : m_indexFile(std::move(indexFile)) {}
+
+void ArchiveIndex::update(const std::vector<std::filesystem::path>& directories, unsigned jobs) {
+  Timer t(__FUNCTION__);
+
+  if (m_archives.empty()) {
+    load();
+  }
+
+  // find archives
+  vector<fs::path> paths;
+  for (const auto& directory : directories) {
+    if (!fs::exists(directory)) {
+      continue;
+    }
+    for (const auto& entry : fs::recursive_directory_iterator(
+             directory, fs::directory_options::skip_permission_denied)) {
+      if (entry.is_regular_file() && entry.path().extension() == ".pak") {
+        paths.push_back(entry.path());
+      }
+    }
+  }
+  ranges::sort(paths);
+
+  unordered_map<fs::path, archive_t*> known;
+  for (auto& archive : m_archives) {
+    known[archive.path] = &archive;
+  }
+
+  vector<archive_t> archives;
+  archives.reserve(paths.size());
+  vector<size_t> outdated;
+  bool changed = paths.size() != m_archives.size();
+
+  for (auto& path : paths) {
+    error_code ec;
+    const int64_t mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+    if (ec) {
+      spdlog::warn("failed to get the modification time of {}: {}", path.string(), ec.message());
+      continue;
+    }
+    const uint64_t size = fs::file_size(path, ec);
+    if (ec) {
+      spdlog::warn("failed to get the size of {}: {}", path.string(), ec.message());
+      continue;
+    }
+
+    // reuse entries of unchanged archives
+    if (auto it = known.find(path);
+        it != known.end() && it->second->mtime == mtime && it->second->size == size) {
+      archives.push_back(std::move(*it->second));
+      continue;
+    }
+
+    changed = true;
+    outdated.push_back(archives.size());
+    archives.push_back({std::move(path), mtime, size, {}});
+  }
+
+  // read the central directories of new and modified archives in parallel
+  parallelFor(outdated.size(), jobs, [&](size_t i) {
+    archive_t& archive = archives[outdated[i]];
+    spdlog::debug("indexing {}", archive.path.string());
+    try {
+      archive.entries = ZipDirectory::read(archive.path);
+    } catch (const runtime_error& e) {
+      spdlog::warn("failed to index {}: {}", archive.path.string(), e.what());
+      // mark as invalid
+      archive.path.clear();
+    }
+  });
+  erase_if(archives, [](const archive_t& archive) {
+    return archive.path.empty();
+  });
+
+  m_archives = std::move(archives);
+  buildLookup();
+
+  if (changed) {
+    try {
+      save();
+    } catch (const exception& e) {
+      spdlog::warn("failed to save archive index {}: {}", m_indexFile.string(), e.what());
+    }
+  }
+}
+
+std::vector<ArchiveIndex::Match> ArchiveIndex::find(std::string_view pattern) const {
+  // only entries starting with the part before the first wildcard can match
+  const string_view prefix = pattern.substr(0, pattern.find_first_of("*?"));
+
+  vector<Match> result;
+  auto it = ranges::lower_bound(m_lookup, prefix, {}, &lookup_t::name);
+  for (; it != m_lookup.end() && it->name.starts_with(prefix); ++it) {
+    if (matches(pattern, it->name)) {
+      const archive_t& archive = m_archives[it->archive];
+      result.push_back({archive.path, archive.entries[it->entry]});
+    }
+  }
+  return result;
+}
+
+bool ArchiveIndex::matches(std::string_view pattern, std::string_view str) noexcept {
+  size_t p = 0;
+  size_t s = 0;
+  // position after the last '*' and the position in str it has been matched up to
+  size_t starPattern = string_view::npos;
+  size_t starString  = 0;
+
+  while (s < str.size()) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == str[s])) {
+      p++;
+      s++;
+    } else if (p < pattern.size() && pattern[p] == '*') {
+      starPattern = ++p;
+      starString  = s;
+    } else if (starPattern != string_view::npos) {
+      // let the last '*' consume one more character
+      p = starPattern;
+      s = ++starString;
+    } else {
+      return false;
+    }
+  }
+
+  while (p < pattern.size() && pattern[p] == '*') {
+    p++;
+  }
+  return p == pattern.size();
+}
+
+bool ArchiveIndex::load() {
+  Timer t(__FUNCTION__);
+
+  ifstream in(m_indexFile, ios::binary);
+  if (!in) {
+    return false;
+  }
+
+  try {
+    in.exceptions(ios::failbit | ios::badbit | ios::eofbit);
+
+    if (read<uint32_t>(in) != magic || read<uint32_t>(in) != version) {
+      spdlog::debug("ignoring archive index {} with unknown format", m_indexFile.string());
+      return false;
+    }
+
+    vector<archive_t> archives(read<uint32_t>(in));
+    for (auto& archive : archives) {
+      archive.path  = readString(in);
+      archive.mtime = read<int64_t>(in);
+      archive.size  = read<uint64_t>(in);
+      archive.entries.resize(read<uint32_t>(in));
+      for (auto& entry : archive.entries) {
+        entry.name             = readString(in);
+        entry.offset           = read<uint64_t>(in);
+        entry.compressedSize   = read<uint64_t>(in);
+        entry.uncompressedSize = read<uint64_t>(in);
+        entry.crc              = read<uint32_t>(in);
+        entry.method           = read<uint16_t>(in);
+        entry.flags            = read<uint16_t>(in);
+      }
+    }
+    m_archives = std::move(archives);
+  } catch (const exception& e) {
+    spdlog::warn("failed to load archive index {}: {}", m_indexFile.string(), e.what());
+    return false;
+  }
+
+  buildLookup();
+  return true;
+}
+
+void ArchiveIndex::save() const noexcept(false) {
+  Timer t(__FUNCTION__);
+
+  fs::create_directories(m_indexFile.parent_path());
+
+  // write to a temporary file first to not leave a broken index behind
+  fs::path tempFile = m_indexFile;
+  tempFile += ".tmp";
+  {
+    ofstream out(tempFile, ios::binary);
+    out.exceptions(ios::failbit | ios::badbit);
+
+    write(out, magic);
+    write(out, version);
+    write(out, static_cast<uint32_t>(m_archives.size()));
+    for (const auto& archive : m_archives) {
+      writeString(out, archive.path.string());
+      write(out, archive.mtime);
+      write(out, archive.size);
+      write(out, static_cast<uint32_t>(archive.entries.size()));
+      for (const auto& entry : archive.entries) {
+        writeString(out, entry.name);
+        write(out, entry.offset);
+        write(out, entry.compressedSize);
+        write(out, entry.uncompressedSize);
+        write(out, entry.crc);
+        write(out, entry.method);
+        write(out, entry.flags);
+      }
+    }
+  }
+  fs::rename(tempFile, m_indexFile);
+}
+
+void ArchiveIndex::buildLookup() {
+  m_lookup.clear();
+  for (uint32_t a = 0; a < m_archives.size(); a++) {
+    const auto& entries = m_archives[a].entries;
+    for (uint32_t e = 0; e < entries.size(); e++) {
+      m_lookup.push_back({entries[e].name, a, e});
+    }
+  }
+  ranges::sort(m_lookup, {}, &lookup_t::name);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ZipDirectory.h"
+
+/**
+ * @brief Persistent index of the entries of all archives inside a set of directories
+ *
+ * The index is stored on disk and only archives whose modification time or size have changed are
+ * read again when updating it.
+ */
+class ArchiveIndex {
+public:
+  struct Match {
+    const std::filesystem::path& archive;
+    const ZipDirectory::Entry& entry;
+  };
+
+  /**
+   * @param indexFile File to store the index in
+   */
+  explicit ArchiveIndex(std::filesystem::path indexFile) noexcept;
+
+  /**
+   * @brief Load the index file, scan the provided directories for archives, and save the index if
+   * anything has changed
+   * @param directories Directories to search for .pak files
+   * @param jobs Number of threads reading archives
+   */
+  void update(const std::vector<std::filesystem::path>& directories, unsigned jobs);
+
+  /**
+   * @brief Find all entries whose name matches the provided pattern
+   * @param pattern Pattern to match, '*' matches any sequence of characters and '?' matches a
+   * single character
+   */
+  std::vector<Match> find(std::string_view pattern) const;
+
+  /**
+   * @brief Check if a string matches a pattern containing '*' and '?' wildcards
+   */
+  static bool matches(std::string_view pattern, std::string_view str) noexcept;
+
+private:
+  static constexpr uint32_t magic   = 0x49415052;  // "RPAI"
+  static constexpr uint32_t version = 1;
+
+  struct archive_t {
+    std::filesystem::path path;
+    int64_t mtime;
+    uint64_t size;
+    std::vector<ZipDirectory::Entry> entries;
+  };
+
+  struct lookup_t {
+    std::string_view name;
+    uint32_t archive;
+    uint32_t entry;
+  };
+
+  /**
+   * @brief Load the index file
+   * @return true if the index has been loaded
+   */
+  bool load();
+
+  /**
+   * @brief Save the index file
+   * @throw std::runtime_error
+   */
+  void save() const noexcept(false);
+
+  /**
+   * @brief Rebuild the lookup table used by find()
+   */
+  void buildLookup();
+
+  std::filesystem::path m_indexFile;
+  std::vector<archive_t> m_archives;
+  std::vector<lookup_t> m_lookup;  // sorted by name
+};
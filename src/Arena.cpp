@@ -0,0 +1,57 @@
+#include "Arena.h"
+
+#include <atomic>
+#include <spdlog/spdlog.h>
+#include <utility>
+
+using namespace std;
+
+namespace {
+// updated once per arena, the allocations themselves are not synchronized
+atomic<uint64_t> totalAllocations         = 0;
+atomic<uint64_t> totalUpstreamAllocations = 0;
+}  // namespace
+
+Arena::Arena(std::string description, size_t initialSize)
+    : m_description(std::move(description)), m_buffer(initialSize, &m_upstream) {}
+
+Arena::~Arena() {
+  spdlog::debug("{}: {} allocations ({} bytes), {} heap allocations ({} bytes)", m_description,
+                m_allocations, m_bytes, m_upstream.allocations, m_upstream.bytes);
+  totalAllocations.fetch_add(m_allocations, memory_order_relaxed);
+  totalUpstreamAllocations.fetch_add(m_upstream.allocations, memory_order_relaxed);
+}
+
+Arena::statistics_t Arena::totals() noexcept {
+  return {totalAllocations.load(memory_order_relaxed),
+          totalUpstreamAllocations.load(memory_order_relaxed)};
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment) {
+  m_allocations++;
+  m_bytes += bytes;
+  return m_buffer.allocate(bytes, alignment);
+}
+
+void Arena::do_deallocate(void* p, size_t bytes, size_t alignment) {
+  // no-op, memory is released when the arena is destroyed
+  m_buffer.deallocate(p, bytes, alignment);
+}
+
+bool Arena::do_is_equal(const memory_resource& other) const noexcept {
+  return this == &other;
+}
+
+void* Arena::CountingResource::do_allocate(size_t bytes, size_t alignment) {
+  allocations++;
+  this->bytes += bytes;
+  return pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void Arena::CountingResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+  pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool Arena::CountingResource::do_is_equal(const memory_resource& other) const noexcept {
+  return this == &other;
+}
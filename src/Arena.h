@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+
+/**
+ * @brief Memory resource for transient allocations made while processing a single file
+ *
+ * Allocations are served from a monotonic buffer and released in one step when the arena is
+ * destroyed. On destruction, the number of allocations served by the arena and the number of
+ * allocations that actually reached the global heap are logged and added to the totals of all
+ * arenas.
+ */
+class Arena : public std::pmr::memory_resource {
+public:
+  struct statistics_t {
+    uint64_t allocations;          //! allocations served by arenas
+    uint64_t upstreamAllocations;  //! allocations forwarded to the global heap by arenas
+  };
+
+  /**
+   * @param description Description used when logging allocation statistics
+   * @param initialSize Size of the first buffer requested from the global heap
+   */
+  explicit Arena(std::string description, size_t initialSize = 64 * 1024);
+  ~Arena() override;
+
+  Arena(const Arena&)            = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  /**
+   * @brief Number of allocations served by the arena
+   */
+  size_t allocations() const noexcept { return m_allocations; }
+
+  /**
+   * @brief Number of allocations forwarded to the global heap
+   */
+  size_t upstreamAllocations() const noexcept { return m_upstream.allocations; }
+
+  /**
+   * @brief Allocations of all arenas destroyed so far, used to show the heap allocations they saved
+   */
+  static statistics_t totals() noexcept;
+
+private:
+  /**
+   * @brief Upstream resource counting the allocations that reach the global heap
+   */
+  struct CountingResource : std::pmr::memory_resource {
+    size_t allocations = 0;
+    size_t bytes       = 0;
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const memory_resource& other) const noexcept override;
+  };
+
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const memory_resource& other) const noexcept override;
+
+  std::string m_description;
+  CountingResource m_upstream;
+  std::pmr::monotonic_buffer_resource m_buffer;
+  size_t m_allocations = 0;
+  size_t m_bytes       = 0;
+};
@@ -0,0 +1,25 @@
+#include "AsyncLogger.h"
+
+#include <spdlog/async.h>
+#include <spdlog/spdlog.h>
+#include <utility>
+
+using namespace std;
+
+AsyncLogger::AsyncLogger(spdlog::sink_ptr sink, spdlog::level::level_enum level)
+    : m_previous(spdlog::default_logger()),
+      m_threadPool(make_shared<spdlog::details::thread_pool>(queueSize, 1)) {
+  // unnamed like the default logger, so the output looks the same
+  auto logger = make_shared<spdlog::async_logger>("", std::move(sink), m_threadPool,
+                                                  spdlog::async_overflow_policy::block);
+  logger->set_level(level);
+  spdlog::set_default_logger(std::move(logger));
+}
+
+AsyncLogger::~AsyncLogger() {
+  // replaces the registered logger of the same name as well
+  spdlog::set_default_logger(m_previous);
+
+  // the worker thread writes all queued messages before it stops
+  m_threadPool.reset();
+}
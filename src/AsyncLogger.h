@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <spdlog/common.h>
+
+namespace spdlog {
+class logger;
+namespace details {
+class thread_pool;
+}
+}  // namespace spdlog
+
+/**
+ * @brief Replaces the default logger with one writing on a background thread while it exists
+ *
+ * Messages are passed through a bounded queue, logging threads only wait when it is full. The
+ * previous default logger is restored once all queued messages have been written.
+ */
+class AsyncLogger {
+public:
+  /**
+   * @param sink Sink to write to
+   * @param level Log level of the new default logger
+   */
+  AsyncLogger(spdlog::sink_ptr sink, spdlog::level::level_enum level);
+  ~AsyncLogger();
+
+  AsyncLogger(const AsyncLogger&)            = delete;
+  AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+private:
+  static constexpr size_t queueSize = 8192;
+
+  std::shared_ptr<spdlog::logger> m_previous;
+  std::shared_ptr<spdlog::details::thread_pool> m_threadPool;
+};
@@ -0,0 +1,230 @@
+#include "Daemon.h"
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "Jobs.h"
+#include "Settings.h"
+#include "TaskGraph.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+using json   = nlohmann::json;
+
+namespace {
+/**
+ * @brief Read settings from a request, missing values keep their defaults
+ */
+Settings settingsFromJson(const json& values) {
+  Settings settings;
+  settings.resupplyPeriod     = values.value("resupplyPeriod", settings.resupplyPeriod);
+  settings.regenerationPeriod = values.value("regenerationPeriod", settings.regenerationPeriod);
+  settings.radiusMultiplier   = values.value("radiusMultiplier", settings.radiusMultiplier);
+  settings.limitMultiplier    = values.value("limitMultiplier", settings.limitMultiplier);
+  settings.limitFallback      = values.value("limitFallback", settings.limitFallback);
+  return settings;
+}
+
+/**
+ * @brief Send all data, the connection might not accept everything at once
+ * @throw std::runtime_error
+ */
+void sendAll(int connection, string_view data) noexcept(false) {
+  while (!data.empty()) {
+    const ssize_t sent = send(connection, data.data(), data.size(), MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw runtime_error("send() failed: "s + strerror(errno));
+    }
+    data.remove_prefix(static_cast<size_t>(sent));
+  }
+}
+}  // namespace
+
+Daemon::Daemon(Patcher& patcher, std::filesystem::path socketPath, unsigned jobs) noexcept(false)
+    : m_patcher(patcher), m_defaultOutputPath(patcher.outputPath()),
+      m_socketPath(std::move(socketPath)), m_jobs(jobs) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  const string path  = m_socketPath.string();
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw runtime_error("socket path too long: " + path);
+  }
+  memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  m_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (m_socket < 0) {
+    throw runtime_error("socket() failed: "s + strerror(errno));
+  }
+
+  // Remove the socket of a previous run, unless a daemon is still listening on it. Other files are
+  // kept, bind() fails for them.
+  error_code ec;
+  if (fs::is_socket(m_socketPath, ec)) {
+    const int probe    = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const bool running = probe >= 0 && connect(probe, reinterpret_cast<const sockaddr*>(&address),
+                                               sizeof(address)) == 0;
+    if (probe >= 0) {
+      close(probe);
+    }
+    if (running) {
+      close(m_socket);
+      throw runtime_error("another daemon is listening on " + path);
+    }
+    fs::remove(m_socketPath, ec);
+  }
+
+  if (bind(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(m_socket, 16) != 0) {
+    const string error = strerror(errno);
+    close(m_socket);
+    throw runtime_error("cannot listen on " + path + ": " + error);
+  }
+
+  spdlog::info("listening on {}", path);
+}
+
+Daemon::~Daemon() {
+  close(m_socket);
+  error_code ec;
+  fs::remove(m_socketPath, ec);
+}
+
+void Daemon::run() noexcept(false) {
+  while (true) {
+    const int connection = accept4(m_socket, nullptr, nullptr, SOCK_CLOEXEC);
+    if (connection < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      throw runtime_error("accept() failed: "s + strerror(errno));
+    }
+
+    bool keepRunning = true;
+    try {
+      keepRunning = serve(connection);
+    } catch (const runtime_error& e) {
+      spdlog::warn("connection closed: {}", e.what());
+    }
+    close(connection);
+
+    if (!keepRunning) {
+      spdlog::info("shutting down");
+      return;
+    }
+  }
+}
+
+bool Daemon::serve(int connection) {
+  string buffer;
+  array<char, 4096> chunk;
+
+  while (true) {
+    const ssize_t received = recv(connection, chunk.data(), chunk.size(), 0);
+    if (received < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw runtime_error("recv() failed: "s + strerror(errno));
+    }
+    if (received == 0) {
+      return true;
+    }
+    buffer.append(chunk.data(), static_cast<size_t>(received));
+
+    // process all complete lines
+    size_t begin = 0;
+    for (size_t end = buffer.find('\n'); end != string::npos; end = buffer.find('\n', begin)) {
+      bool shutdown = false;
+      sendAll(connection, handle(string_view(buffer).substr(begin, end - begin), shutdown) + "\n");
+      if (shutdown) {
+        return false;
+      }
+      begin = end + 1;
+    }
+    buffer.erase(0, begin);
+
+    // the rest of an oversized request cannot be told apart from the next one
+    if (buffer.size() > maxRequestSize) {
+      sendAll(connection, json{{"ok", false}, {"error", "request too large"}}.dump() + "\n");
+      return true;
+    }
+  }
+}
+
+std::string Daemon::handle(std::string_view request, bool& shutdown) {
+  using clock = chrono::steady_clock;
+
+  json reply;
+  try {
+    const json values    = json::parse(request);
+    const string command = values.value("command", "patch");
+    if (command == "shutdown") {
+      shutdown = true;
+      return json{{"ok", true}}.dump();
+    }
+    if (command != "patch") {
+      throw runtime_error("unknown command: " + command);
+    }
+
+    const string job        = values.value("mod", "vanilla");
+    const fs::path output   = values.value("output", m_defaultOutputPath.string());
+    const Settings settings = settingsFromJson(values.value("settings", json::object()));
+
+    const auto start = clock::now();
+    m_patcher.setOutputPath(output);
+    m_patcher.setSettings(settings);
+    // archives installed since the last job are indexed, unchanged ones are skipped
+    m_patcher.updateArchiveIndex();
+    const auto scanned = clock::now();
+
+    TaskGraph graph;
+    addJob(m_patcher, graph, job);
+    graph.run(m_jobs);
+    const auto patched = clock::now();
+
+    vector<string> changed;
+    for (const auto& file : m_patcher.changedFiles()) {
+      changed.push_back(file.generic_string());
+    }
+    const auto end = clock::now();
+
+    spdlog::info("{} -> {}: {} changed files in {} µs", job, output.string(), changed.size(),
+                 (end - start) / 1us);
+
+    reply = {
+        {"ok", true},
+        {"changed", changed},
+        {"timings",
+         {
+             {"scan", (scanned - start) / 1us},
+             {"patch", (patched - scanned) / 1us},
+             {"compare", (end - patched) / 1us},
+             {"total", (end - start) / 1us},
+         }},
+    };
+  } catch (const exception& e) {
+    spdlog::warn("request failed: {}", e.what());
+    reply = {
+        {"ok", false},
+        {"error", e.what()},
+    };
+  }
+
+  return reply.dump();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include "Patcher.h"
+
+/**
+ * @brief Serves patch jobs over a Unix domain socket, keeping the patcher and its caches warm
+ *
+ * Requests and replies are JSON objects, one per line. A connection can send any number of
+ * requests, all requests are processed one after another.
+ */
+class Daemon {
+public:
+  /**
+   * @param patcher Patcher used for all jobs, its output directory is the default for requests
+   * @param socketPath Path of the socket, a stale socket of a previous run is replaced
+   * @param jobs Number of threads used per job
+   * @throw std::runtime_error If the socket cannot be created, e.g. because another daemon is
+   * listening on it or the path is not a socket
+   */
+  Daemon(Patcher& patcher, std::filesystem::path socketPath, unsigned jobs) noexcept(false);
+  ~Daemon();
+
+  Daemon(const Daemon&)            = delete;
+  Daemon& operator=(const Daemon&) = delete;
+
+  /**
+   * @brief Accept connections until a shutdown request has been received
+   * @throw std::runtime_error
+   */
+  void run() noexcept(false);
+
+private:
+  // longer requests close the connection, a client cannot make the daemon buffer without limit
+  static constexpr size_t maxRequestSize = 64 * 1024;
+
+  /**
+   * @brief Process the requests of a connection until it is closed
+   * @return false if a shutdown has been requested
+   */
+  bool serve(int connection);
+
+  /**
+   * @brief Process a single request
+   * @param request Request as JSON
+   * @param shutdown Set if a shutdown has been requested
+   * @return Reply as JSON
+   */
+  std::string handle(std::string_view request, bool& shutdown);
+
+  Patcher& m_patcher;
+  std::filesystem::path m_defaultOutputPath;
+  std::filesystem::path m_socketPath;
+  unsigned m_jobs;
+  int m_socket = -1;
+};
@@ -0,0 +1,169 @@
+#include "EntryCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <spdlog/spdlog.h>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <zlib.h>
+
+#include "Timer.h"
+#include "spdlog/fmt/bundled/format.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+EntryCache::EntryCache(std::filesystem::path directory, uint64_t sizeLimit) noexcept
+    : m_directory(std::move(directory)), m_sizeLimit(sizeLimit) {
+  if (m_sizeLimit == 0) {
+    return;
+  }
+
+  error_code ec;
+  for (const auto& entry : fs::directory_iterator(m_directory, ec)) {
+    if (!entry.is_regular_file(ec) || entry.path().extension() == ".tmp") {
+      continue;
+    }
+    // an entry removed in the meantime would add uintmax_t(-1)
+    const auto size = entry.file_size(ec);
+    if (!ec) {
+      m_size += size;
+    }
+  }
+}
+
+std::optional<std::vector<char>> EntryCache::load(key_t key, std::string_view kind) const {
+  if (m_sizeLimit == 0) {
+    return nullopt;
+  }
+
+  const fs::path file = path(key, kind);
+  ifstream in(file, ios::binary);
+  if (!in) {
+    return nullopt;
+  }
+
+  // header: magic, version, CRC32 of the stored data
+  uint32_t header[headerSize];
+  error_code ec;
+  const auto fileSize = fs::file_size(file, ec);
+  if (ec || fileSize < sizeof(header) ||
+      !in.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != magic ||
+      header[1] != version) {
+    spdlog::debug("ignoring invalid cache entry {}", file.string());
+    return nullopt;
+  }
+
+  vector<char> data(fileSize - sizeof(header));
+  if (!in.read(data.data(), static_cast<streamsize>(data.size())) ||
+      keyOf(data).crc != header[2]) {
+    spdlog::debug("ignoring corrupted cache entry {}", file.string());
+    return nullopt;
+  }
+
+  // mark as recently used
+  fs::last_write_time(file, fs::file_time_type::clock::now(), ec);
+
+  spdlog::trace("cache hit: {}", file.string());
+  return data;
+}
+
+void EntryCache::store(key_t key, std::string_view kind, std::span<const char> data) const {
+  if (m_sizeLimit == 0) {
+    return;
+  }
+
+  Timer t(__FUNCTION__);
+  const fs::path file = path(key, kind);
+
+  // a replaced entry no longer counts
+  error_code ec;
+  uintmax_t replacedSize = fs::file_size(file, ec);
+  if (ec) {
+    replacedSize = 0;
+  }
+
+  // write to a temporary file first, other threads or processes might read the same entry
+  fs::path tempFile = file;
+  tempFile += fmt::format(".{}.tmp", hash<thread::id>{}(this_thread::get_id()));
+  try {
+    fs::create_directories(m_directory);
+    {
+      ofstream out(tempFile, ios::binary);
+      out.exceptions(ios::failbit | ios::badbit);
+
+      const uint32_t header[headerSize] = {magic, version, keyOf(data).crc};
+      out.write(reinterpret_cast<const char*>(header), sizeof(header));
+      out.write(data.data(), static_cast<streamsize>(data.size()));
+    }
+    fs::rename(tempFile, file);
+  } catch (const exception& e) {
+    spdlog::warn("failed to store cache entry {}: {}", file.string(), e.what());
+    fs::remove(tempFile, ec);
+    return;
+  }
+
+  // wraps around correctly if the new entry is smaller than the replaced one
+  if ((m_size += sizeof(uint32_t) * headerSize + data.size() - replacedSize) > m_sizeLimit) {
+    evict();
+  }
+}
+
+EntryCache::key_t EntryCache::keyOf(std::span<const char> data) noexcept {
+  // zlib takes 32 bit lengths
+  uLong crc = crc32(0L, Z_NULL, 0);
+  for (size_t offset = 0; offset < data.size();) {
+    const auto length = static_cast<uInt>(min<size_t>(data.size() - offset, 1u << 30));
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(data.data() + offset), length);
+    offset += length;
+  }
+  return {static_cast<uint32_t>(crc), data.size()};
+}
+
+std::filesystem::path EntryCache::path(key_t key, std::string_view kind) const {
+  return m_directory / fmt::format("{:08x}-{}.{}", key.crc, key.size, kind);
+}
+
+void EntryCache::evict() const {
+  lock_guard lock(m_evictMutex);
+  // another thread has evicted while this one was waiting
+  if (m_size <= m_sizeLimit) {
+    return;
+  }
+
+  vector<tuple<fs::file_time_type, uint64_t, fs::path>> entries;
+  uint64_t totalSize = 0;
+
+  error_code ec;
+  for (const auto& entry : fs::directory_iterator(m_directory, ec)) {
+    if (!entry.is_regular_file(ec) || entry.path().extension() == ".tmp") {
+      continue;
+    }
+    const auto size = entry.file_size(ec);
+    if (ec) {
+      continue;
+    }
+    totalSize += size;
+    entries.emplace_back(entry.last_write_time(ec), size, entry.path());
+  }
+
+  const auto target = static_cast<uint64_t>(static_cast<double>(m_sizeLimit) * evictionTarget);
+  if (totalSize > m_sizeLimit) {
+    // oldest first
+    ranges::sort(entries);
+    for (const auto& [time, size, file] : entries) {
+      if (totalSize <= target) {
+        break;
+      }
+      spdlog::debug("evicting cache entry {}", file.string());
+      if (fs::remove(file, ec)) {
+        totalSize -= size;
+      }
+    }
+  }
+
+  m_size = totalSize;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Content-addressed on-disk cache for data derived from archive entries and files
+ *
+ * Entries are identified by the CRC32 and size of the data they were derived from, and a kind
+ * describing what has been stored, e.g. the decompressed data or the parsed item lists. The size of
+ * the cache is read once and then tracked in memory. When it exceeds the limit, the least recently
+ * used entries are removed until the cache is below the eviction target.
+ */
+class EntryCache {
+public:
+  struct key_t {
+    uint32_t crc;
+    uint64_t size;
+  };
+
+  /**
+   * @param directory Directory to store the cached data in, its size is read here
+   * @param sizeLimit Maximum size of the cache in bytes, 0 disables the cache
+   */
+  EntryCache(std::filesystem::path directory, uint64_t sizeLimit) noexcept;
+
+  /**
+   * @brief Load cached data
+   * @return The cached data or std::nullopt if it is not cached or invalid
+   */
+  std::optional<std::vector<char>> load(key_t key, std::string_view kind) const;
+
+  /**
+   * @brief Store data in the cache, errors are logged and otherwise ignored
+   */
+  void store(key_t key, std::string_view kind, std::span<const char> data) const;
+
+  /**
+   * @brief Calculate the key of the provided data
+   */
+  static key_t keyOf(std::span<const char> data) noexcept;
+
+private:
+  static constexpr uint32_t magic   = 0x43455052;  // "RPEC"
+  static constexpr uint32_t version = 1;
+
+  // magic, version and CRC32 of the stored data precede the data
+  static constexpr size_t headerSize = 3;
+
+  // eviction removes entries down to this share of the limit, so the stores following it do not
+  // have to evict again
+  static constexpr double evictionTarget = 0.9;
+
+  std::filesystem::path path(key_t key, std::string_view kind) const;
+
+  /**
+   * @brief Remove the least recently used entries until the cache is below the eviction target,
+   * the tracked size is set to the size found in the directory
+   */
+  void evict() const;
+
+  std::filesystem::path m_directory;
+  uint64_t m_sizeLimit;
+  // size of all entries, other processes sharing the directory are only noticed by evict()
+  mutable std::atomic<uint64_t> m_size = 0;
+  mutable std::mutex m_evictMutex;
+};
@@ -0,0 +1,142 @@
+#include "FileDeduplicator.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <openssl/evp.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+/**
+ * @brief Open the source for reading and create the target for writing
+ * @return false if either cannot be opened, no descriptor is left open
+ */
+bool openFiles(const fs::path& source, const fs::path& target, int& in, int& out) {
+  in = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in < 0) {
+    return false;
+  }
+  out = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (out < 0) {
+    close(in);
+    return false;
+  }
+  return true;
+}
+
+// shares all extents of the source, supported by e.g. btrfs, XFS and bcachefs
+bool reflink(const fs::path& source, const fs::path& target) {
+  int in, out;
+  if (!openFiles(source, target, in, out)) {
+    return false;
+  }
+  const bool cloned = ioctl(out, FICLONE, in) == 0;
+  close(in);
+  close(out);
+  return cloned;
+}
+
+// copies inside the kernel, network filesystems copy on the server and some local ones share
+// extents
+bool copyRange(const fs::path& source, const fs::path& target, uintmax_t size) {
+  int in, out;
+  if (!openFiles(source, target, in, out)) {
+    return false;
+  }
+  uintmax_t copied = 0;
+  while (copied < size) {
+    const ssize_t length = copy_file_range(in, nullptr, out, nullptr, size - copied, 0);
+    if (length <= 0) {
+      break;
+    }
+    copied += static_cast<uintmax_t>(length);
+  }
+  close(in);
+  close(out);
+  return copied == size;
+}
+}  // namespace
+
+FileDeduplicator::key_t FileDeduplicator::keyOf(std::span<const char> data) noexcept(false) {
+  key_t key;
+  if (EVP_Digest(data.data(), data.size(), key.data(), nullptr, EVP_sha256(), nullptr) != 1) {
+    throw runtime_error("EVP_Digest error");
+  }
+  return key;
+}
+
+bool FileDeduplicator::share(const key_t& key, const std::filesystem::path& file) const {
+  // only the lookup is done while holding the lock, the filesystem work of other threads is not
+  // blocked by it
+  file_t source;
+  {
+    lock_guard lock(m_mutex);
+    const auto it = m_files.find(key);
+    if (it == m_files.end()) {
+      return false;
+    }
+    source = it->second;
+  }
+
+  // the recorded file has been replaced or modified since
+  error_code ec;
+  if (fs::last_write_time(source.path, ec) != source.mtime || ec ||
+      fs::file_size(source.path, ec) != source.size || ec) {
+    lock_guard lock(m_mutex);
+    // another thread might have recorded a new file in the meantime
+    if (const auto it = m_files.find(key);
+        it != m_files.end() && it->second.path == source.path && it->second.mtime == source.mtime) {
+      m_files.erase(it);
+    }
+    return false;
+  }
+
+  if (fs::equivalent(source.path, file, ec)) {
+    return true;
+  }
+  fs::remove(file, ec);
+
+  if (reflink(source.path, file)) {
+    spdlog::debug("reflinked {} to {}", file.string(), source.path.string());
+    return true;
+  }
+  fs::remove(file, ec);
+
+  // the patcher replaces hard linked files instead of modifying them
+  fs::create_hard_link(source.path, file, ec);
+  if (!ec) {
+    spdlog::debug("hard linked {} to {}", file.string(), source.path.string());
+    return true;
+  }
+
+  if (copyRange(source.path, file, source.size)) {
+    spdlog::debug("copied {} to {} in the kernel", source.path.string(), file.string());
+    return true;
+  }
+  fs::remove(file, ec);
+
+  spdlog::debug("cannot share {} with {}", source.path.string(), file.string());
+  return false;
+}
+
+void FileDeduplicator::add(const key_t& key, const std::filesystem::path& file) const {
+  error_code ec;
+  file_t recorded{file, fs::last_write_time(file, ec), 0};
+  if (!ec) {
+    recorded.size = fs::file_size(file, ec);
+  }
+  if (ec) {
+    spdlog::warn("cannot record {} for deduplication: {}", file.string(), ec.message());
+    return;
+  }
+
+  lock_guard lock(m_mutex);
+  m_files.insert_or_assign(key, std::move(recorded));
+}
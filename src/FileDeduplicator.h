@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <span>
+
+/**
+ * @brief Shares the storage of identical files written during the lifetime of the object
+ *
+ * A file is written normally and recorded with add(). Later files with the same content are
+ * created by share() as a reflink of it, as a hard link where reflinks
+ * are not supported, or with copy_file_range() as a last resort. A recorded file is only shared
+ * while its modification time and size are unchanged.
+ */
+class FileDeduplicator {
+public:
+  using key_t = std::array<unsigned char, 32>;
+
+  /**
+   * @brief Calculate the key of the provided data
+   * @throw std::runtime_error
+   */
+  static key_t keyOf(std::span<const char> data) noexcept(false);
+
+  /**
+   * @brief Create a file sharing the storage of a recorded file with the same key
+   * @param key Key of the contents of the file
+   * @param file File to create, an existing file is replaced
+   * @return false if no such file has been recorded or it cannot be shared, the file has to be
+   * written instead
+   */
+  bool share(const key_t& key, const std::filesystem::path& file) const;
+
+  /**
+   * @brief Record a file that has been written, it is shared by later calls to share()
+   */
+  void add(const key_t& key, const std::filesystem::path& file) const;
+
+private:
+  struct file_t {
+    std::filesystem::path path;
+    std::filesystem::file_time_type mtime;
+    uintmax_t size = 0;
+  };
+
+  mutable std::mutex m_mutex;
+  mutable std::map<key_t, file_t> m_files;
+};
@@ -1,60 +1,114 @@
 #pragma once
 
-#include <sstream>
+#include <cctype>
+#include <charconv>
+#include <memory_resource>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "spdlog/fmt/bundled/format.h"
+
 /**
  * @brief Helper class to parse items
  */
 class Item {
 public:
-  std::vector<std::string> strings;
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
+  Item() = default;
+  explicit Item(const allocator_type& alloc) : strings(alloc), condition(alloc) {}
+  Item(const Item& other, const allocator_type& alloc)
+      : strings(other.strings, alloc), unknown(other.unknown), value(other.value),
+        condition(other.condition, alloc) {}
+  Item(Item&& other, const allocator_type& alloc)
+      : strings(std::move(other.strings), alloc), unknown(other.unknown), value(other.value),
+        condition(std::move(other.condition), alloc) {}
+  Item(const Item&)            = default;
+  Item(Item&&)                 = default;
+  Item& operator=(const Item&) = default;
+  Item& operator=(Item&&)      = default;
+
+  std::pmr::vector<std::pmr::string> strings;
   int unknown = -1;
   int value   = -1;
-  std::string condition;  // condition before item definition, e.g. '(mod not "mp"'
+  std::pmr::string condition;  // condition before item definition, e.g. '(mod not "mp"'
 
-  friend std::ostream& operator<<(std::ostream& out, const Item& i) {
-    if (!i.condition.empty()) {
-      out << "\t" << i.condition << "\r\n\t";
-    }
-    out << "\t{item";
-    for (const auto& str : i.strings) {
-      out << " \"" << str << "\"";
-    }
-    out << " " << i.unknown << " {value " << i.value << "}}";
-    if (!i.condition.empty()) {
-      out << "\r\n\t)";
-    }
-    return out;
-  }
-
-  friend std::istream& operator>>(std::istream& in, Item& i) {
-    std::string line;
-    getline(in, line);
+  /**
+   * @brief Parse an item definition, e.g. '{item "mp40 ammo" 1 {value 300}}'
+   * @param line Line containing the item definition
+   * @param alloc Allocator to use for the item strings
+   */
+  static Item parse(std::string_view line, const allocator_type& alloc = {}) {
+    Item i(alloc);
 
-    std::istringstream iss(line);
-    std::string token;
+    // split into whitespace separated tokens
+    auto nextToken = [&line]() -> std::string_view {
+      size_t begin = 0;
+      while (begin < line.size() && isspace(static_cast<unsigned char>(line[begin]))) {
+        begin++;
+      }
+      size_t end = begin;
+      while (end < line.size() && !isspace(static_cast<unsigned char>(line[end]))) {
+        end++;
+      }
+      std::string_view token = line.substr(begin, end - begin);
+      line.remove_prefix(end);
+      return token;
+    };
 
     // Skip "{item"
-    iss >> token;
+    nextToken();
 
     // Read strings until we hit a number
-    while (iss >> token) {
-      if (isdigit(token[0])) {
-        i.unknown = std::stoi(token);
+    for (std::string_view token = nextToken(); !token.empty(); token = nextToken()) {
+      if (isdigit(static_cast<unsigned char>(token[0]))) {
+        std::from_chars(token.data(), token.data() + token.size(), i.unknown);
         break;
       }
       // Remove quotes
-      token = token.substr(1, token.length() - 2);
-      i.strings.push_back(token);
+      i.strings.emplace_back(token.substr(1, token.length() - 2));
     }
 
     // Skip "{value"
-    iss >> token;
+    nextToken();
     // Read value
-    iss >> i.value;
+    std::string_view token = nextToken();
+    if (!token.empty() &&
+        std::from_chars(token.data(), token.data() + token.size(), i.value).ec != std::errc{}) {
+      i.value = 0;
+    }
 
-    return in;
+    return i;
   }
 };
+
+/**
+ * @brief Formats an item the way it is written to item lists, without a trailing line break
+ */
+template <>
+struct fmt::formatter<Item> {
+  constexpr auto parse(format_parse_context& ctx) { return ctx.begin(); }
+
+  auto format(const Item& i, format_context& ctx) const {
+    auto out = ctx.out();
+    if (!i.condition.empty()) {
+      out = fmt::format_to(out, "\t{}\r\n\t", std::string_view(i.condition));
+    }
+    out = fmt::format_to(out, "\t{{item");
+    for (const auto& str : i.strings) {
+      out = fmt::format_to(out, " \"{}\"", std::string_view(str));
+    }
+    out = fmt::format_to(out, " {} {{value {}}}}}", i.unknown, i.value);
+    if (!i.condition.empty()) {
+      out = fmt::format_to(out, "\r\n\t)");
+    }
+    return out;
+  }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const Item& i) {
+  return out << fmt::format("{}", i);
+}
@@ -0,0 +1,31 @@
+#include "Jobs.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+TaskGraph::TaskId addJob(const Patcher& patcher, TaskGraph& graph,
+                         std::string_view job) noexcept(false) {
+  if (job == "vanilla") {
+    return patcher.patchVanilla(graph);
+  }
+  if (job == "discover") {
+    return patcher.patchDiscoveredMods(graph);
+  }
+
+  const Mod* mod = mods::find(job);
+  if (mod == nullptr) {
+    throw runtime_error("unknown job: "s + string(job));
+  }
+
+  vector done = {patcher.patchMod(graph, *mod)};
+  if (contains(mod->passes, PostPass::removeResupplyRestrictions)) {
+    done = {patcher.removeResupplyRestrictions(graph, *mod, done)};
+  }
+  if (contains(mod->passes, PostPass::patchVanilla)) {
+    done.push_back(patcher.patchVanilla(graph));
+  }
+  return graph.add("patch "s + string(job), [] {}, done);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <string_view>
+
+#include "Mods.h"
+#include "Patcher.h"
+#include "TaskGraph.h"
+
+/**
+ * @brief Names of the patch jobs, used for the command line flags and daemon requests
+ */
+constexpr auto jobNames = [] {
+  std::array<std::string_view, mods::registry.size() + 2> names;
+  names.front() = "vanilla";
+  for (size_t i = 0; i < mods::registry.size(); i++) {
+    names[i + 1] = mods::registry[i].option;
+  }
+  names.back() = "discover";
+  return names;
+}();
+
+/**
+ * @brief Add the tasks of a patch job
+ * @param patcher Patcher to use
+ * @param graph Graph to add the tasks to
+ * @param job Job name, one of jobNames
+ * @return Task that finishes after all files have been saved
+ * @throw std::runtime_error If the job is unknown
+ */
+TaskGraph::TaskId addJob(const Patcher& patcher, TaskGraph& graph,
+                         std::string_view job) noexcept(false);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <mutex>
+#include <optional>
+#include <regex>
+
+/**
+ * @brief Regular expression that is compiled on first use
+ *
+ * The constructor is constexpr, so global patterns cost nothing at startup. Compilation is done
+ * once, even if several threads use the pattern at the same time, and all users share the compiled
+ * expression.
+ */
+class LazyRegex {
+public:
+  constexpr explicit LazyRegex(const char* pattern) noexcept : m_pattern(pattern) {}
+
+  LazyRegex(const LazyRegex&)            = delete;
+  LazyRegex& operator=(const LazyRegex&) = delete;
+
+  /**
+   * @brief Get the compiled expression, compiling it on the first call
+   * @throw std::regex_error If the pattern is invalid
+   */
+  const std::regex& get() const noexcept(false) {
+    std::call_once(m_compiled, [this] {
+      m_regex.emplace(m_pattern);
+    });
+    return *m_regex;
+  }
+
+private:
+  const char* m_pattern;
+  mutable std::once_flag m_compiled;
+  mutable std::optional<std::regex> m_regex;
+};
@@ -0,0 +1,100 @@
+#include "MappedArchive.h"
+
+#include <algorithm>
+#include <libdeflate.h>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include "Timer.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+struct DecompressorDeleter {
+  void operator()(libdeflate_decompressor* d) const {
+    if (d) {
+      libdeflate_free_decompressor(d);
+    }
+  }
+};
+using DecompressorPtr = std::unique_ptr<libdeflate_decompressor, DecompressorDeleter>;
+
+/**
+ * @brief Get the decompressor of the calling thread, decompressors are not thread-safe
+ */
+libdeflate_decompressor* decompressor() noexcept(false) {
+  thread_local const DecompressorPtr d(libdeflate_alloc_decompressor());
+  if (!d) {
+    throw bad_alloc();
+  }
+  return d.get();
+}
+}  // namespace
+
+MappedArchive::MappedArchive(const std::filesystem::path& archive) noexcept(false)
+    : m_file(archive), m_lastWriteTime(fs::last_write_time(archive)),
+      m_entries(ZipDirectory::parse(m_file.data())) {
+  ranges::sort(m_entries, {}, &ZipDirectory::Entry::name);
+}
+
+const ZipDirectory::Entry* MappedArchive::find(std::string_view name) const noexcept {
+  const auto it = ranges::lower_bound(m_entries, name, {}, &ZipDirectory::Entry::name);
+  return it != m_entries.end() && it->name == name ? &*it : nullptr;
+}
+
+std::optional<std::span<const char>>
+MappedArchive::view(const ZipDirectory::Entry& entry) const noexcept(false) {
+  if (entry.method != methodStore || (entry.flags & flagEncrypted) != 0) {
+    return nullopt;
+  }
+
+  const span<const char> data = ZipDirectory::entryData(m_file.data(), entry);
+  if (data.size() != entry.uncompressedSize ||
+      libdeflate_crc32(0, data.data(), data.size()) != entry.crc) {
+    throw runtime_error("corrupted stored entry " + entry.name);
+  }
+  return data;
+}
+
+std::optional<std::vector<char>>
+MappedArchive::extract(const ZipDirectory::Entry& entry) const noexcept(false) {
+  Timer t(__FUNCTION__);
+  if ((entry.flags & flagEncrypted) != 0 ||
+      (entry.method != methodStore && entry.method != methodDeflate)) {
+    return nullopt;
+  }
+
+  if (auto stored = view(entry)) {
+    return vector<char>(stored->begin(), stored->end());
+  }
+
+  // the size is allocated up front, a corrupted directory must not cause a huge allocation
+  const span<const char> data = ZipDirectory::entryData(m_file.data(), entry);
+  if (entry.uncompressedSize / maxDeflateRatio > data.size()) {
+    throw runtime_error("impossible uncompressed size of " + entry.name);
+  }
+
+  vector<char> result(entry.uncompressedSize);
+  size_t size;
+  if (libdeflate_deflate_decompress(decompressor(), data.data(), data.size(), result.data(),
+                                    result.size(), &size) != LIBDEFLATE_SUCCESS ||
+      size != result.size()) {
+    throw runtime_error("cannot inflate " + entry.name);
+  }
+
+  if (libdeflate_crc32(0, result.data(), result.size()) != entry.crc) {
+    throw runtime_error("CRC mismatch in " + entry.name);
+  }
+  return result;
+}
+
+bool MappedArchive::isOutdated(const std::filesystem::path& archive) const noexcept {
+  error_code ec;
+  const auto lastWriteTime = fs::last_write_time(archive, ec);
+  return ec || lastWriteTime != m_lastWriteTime ||
+         fs::file_size(archive, ec) != m_file.data().size() || ec;
+}
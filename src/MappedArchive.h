@@ -0,0 +1,65 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.h"
+#include "ZipDirectory.h"
+
+/**
+ * @brief Read-only zip reader working on a memory mapping of the archive
+ *
+ * Stored entries are read directly from the mapping, deflated entries are inflated with a single
+ * libdeflate call. Encrypted entries and other compression methods are not supported, callers
+ * fall back to libzip for them.
+ */
+class MappedArchive {
+public:
+  /**
+   * @param archive Archive to map
+   * @throw std::runtime_error
+   */
+  explicit MappedArchive(const std::filesystem::path& archive) noexcept(false);
+
+  /**
+   * @brief Find an entry by its name
+   * @return The entry or nullptr if the archive does not contain it
+   */
+  const ZipDirectory::Entry* find(std::string_view name) const noexcept;
+
+  /**
+   * @brief Get the data of a stored entry without copying it, it is valid as long as this object
+   * @return The data or std::nullopt if the entry is compressed or encrypted
+   * @throw std::runtime_error If the entry is corrupted
+   */
+  std::optional<std::span<const char>>
+  view(const ZipDirectory::Entry& entry) const noexcept(false);
+
+  /**
+   * @brief Extract an entry into a buffer, stored entries can be read with view() instead
+   * @return The uncompressed data or std::nullopt if the entry uses an unsupported feature
+   * @throw std::runtime_error If the entry is corrupted or its size is impossible
+   */
+  std::optional<std::vector<char>>
+  extract(const ZipDirectory::Entry& entry) const noexcept(false);
+
+  /**
+   * @brief Check whether the archive has been modified since it has been mapped
+   */
+  bool isOutdated(const std::filesystem::path& archive) const noexcept;
+
+private:
+  static constexpr uint16_t methodStore   = 0;
+  static constexpr uint16_t methodDeflate = 8;
+  static constexpr uint16_t flagEncrypted = 0x0001;
+
+  // deflate expands data by at most 1032:1, larger sizes of the directory are not trusted
+  static constexpr uint64_t maxDeflateRatio = 1032;
+
+  MappedFile m_file;
+  std::filesystem::file_time_type m_lastWriteTime;
+  std::vector<ZipDirectory::Entry> m_entries;  // sorted by name
+};
@@ -0,0 +1,61 @@
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+MappedFile::MappedFile(const std::filesystem::path& file, Access access) noexcept(false) {
+  const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw runtime_error("cannot open " + file.string() + ": " + strerror(errno));
+  }
+
+  struct stat status{};
+  if (fstat(fd, &status) != 0) {
+    const string error = strerror(errno);
+    close(fd);
+    throw runtime_error("cannot stat " + file.string() + ": " + error);
+  }
+  m_size = static_cast<size_t>(status.st_size);
+
+  // mapping an empty file fails, an empty span is all that is needed
+  if (m_size > 0) {
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      const string error = strerror(errno);
+      close(fd);
+      throw runtime_error("cannot map " + file.string() + ": " + error);
+    }
+    m_data = static_cast<const char*>(data);
+
+    if (access == Access::sequential) {
+      madvise(data, m_size, MADV_SEQUENTIAL);
+    }
+  }
+
+  // the mapping stays valid after closing the file
+  close(fd);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_data(exchange(other.m_data, nullptr)), m_size(exchange(other.m_size, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  swap(m_data, other.m_data);
+  swap(m_size, other.m_size);
+  return *this;
+}
+
+MappedFile::~MappedFile() {
+  if (m_data != nullptr) {
+    munmap(const_cast<char*>(m_data), m_size);
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+/**
+ * @brief Read-only memory mapping of a whole file
+ */
+class MappedFile {
+public:
+  enum class Access {
+    random,
+    sequential,  //! the file is read once from start to end, allows aggressive read-ahead
+  };
+
+  /**
+   * @param file File to map
+   * @param access Expected access pattern
+   * @throw std::runtime_error
+   */
+  explicit MappedFile(const std::filesystem::path& file,
+                      Access access = Access::random) noexcept(false);
+  ~MappedFile();
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  MappedFile(const MappedFile&)            = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  std::span<const char> data() const noexcept { return {m_data, m_size}; }
+
+private:
+  const char* m_data = nullptr;
+  size_t m_size      = 0;
+};
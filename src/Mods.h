@@ -1,7 +1,46 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <string_view>
+
 #include "mods/Hortens_Frontline.h"
 #include "mods/Hotmod1986.h"
 #include "mods/Mace.h"
 #include "mods/Valour.h"
 #include "mods/West81.h"
+
+namespace mods {
+/**
+ * @brief All supported mods
+ */
+inline constexpr std::array registry = {Valour.mod(), Hotmod.mod(), West81.mod(), Mace.mod(),
+                                        HortensFrontline.mod()};
+
+/**
+ * @brief Find a supported mod by its option name
+ * @return The mod or nullptr if there is none
+ */
+constexpr const Mod* find(std::string_view option) noexcept {
+  const auto mod = std::ranges::find(registry, option, &Mod::option);
+  return mod != registry.end() ? &*mod : nullptr;
+}
+
+static_assert(std::ranges::all_of(registry,
+                                  [](const Mod& mod) {
+                                    return std::ranges::count(registry, mod.option,
+                                                              &Mod::option) == 1;
+                                  }),
+              "option names must be unique");
+
+static_assert(std::ranges::all_of(registry,
+                                  [](const Mod& mod) {
+                                    return mod.shortOption.empty() ||
+                                           std::ranges::count(registry, mod.shortOption,
+                                                              &Mod::shortOption) == 1;
+                                  }),
+              "short option names must be unique");
+
+static_assert(std::ranges::all_of(registry, hasUniquePaths),
+              "every file of a mod must be patched once");
+}  // namespace mods
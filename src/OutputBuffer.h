@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+#include "Item.h"
+#include "spdlog/fmt/bundled/format.h"
+
+/**
+ * @brief Builds generated files in memory, so they can be saved with a single write
+ *
+ * Lines are terminated with "\r\n" like the game files.
+ */
+class OutputBuffer {
+public:
+  /**
+   * @param sizeHint Expected size of the output, used to reserve memory up front
+   */
+  explicit OutputBuffer(size_t sizeHint = 0) { m_buffer.reserve(sizeHint); }
+
+  /**
+   * @brief Start a define block
+   */
+  void beginDefine(std::string_view name) {
+    fmt::format_to(fmt::appender(m_buffer), "(define \"{}\"\r\n", name);
+  }
+
+  /**
+   * @brief End the current define block
+   */
+  void endDefine() { line(")"); }
+
+  /**
+   * @brief Add an item on its own line
+   */
+  void item(const Item& item) { fmt::format_to(fmt::appender(m_buffer), "{}\r\n", item); }
+
+  /**
+   * @brief Add a line of text
+   */
+  void line(std::string_view text) {
+    static constexpr std::string_view lineBreak = "\r\n";
+    m_buffer.append(text.data(), text.data() + text.size());
+    m_buffer.append(lineBreak.data(), lineBreak.data() + lineBreak.size());
+  }
+
+  std::span<const char> data() const noexcept { return {m_buffer.data(), m_buffer.size()}; }
+
+  /**
+   * @brief Estimate the size of a formatted item, including the line break
+   */
+  static size_t estimateSize(const Item& item) noexcept {
+    // tabs, keywords, numbers, quotes and line breaks
+    size_t size = 32 + item.condition.size();
+    for (const auto& str : item.strings) {
+      size += str.size() + 3;
+    }
+    return size;
+  }
+
+private:
+  fmt::memory_buffer m_buffer;
+};
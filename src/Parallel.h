@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Call a function for every index in [0, count) on up to the provided number of threads
+ * @param count Number of iterations
+ * @param jobs Number of threads to use, including the calling thread
+ * @param f Function to call, receives the index
+ * @throw Rethrows the first exception thrown by f after all threads have finished
+ */
+template <typename F>
+void parallelFor(size_t count, unsigned jobs, F&& f) {
+  const size_t threadCount = std::min<size_t>(count, std::max(1u, jobs));
+
+  std::atomic<size_t> next = 0;
+  std::exception_ptr error;
+  std::mutex errorMutex;
+
+  auto worker = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      try {
+        f(i);
+      } catch (...) {
+        std::lock_guard lock(errorMutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  };
+
+  {
+    std::vector<std::jthread> threads;
+    for (size_t i = 1; i < threadCount; i++) {
+      threads.emplace_back(worker);
+    }
+    worker();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
@@ -2,27 +2,36 @@
 
 #include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <chrono>
 #include <compare>
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
 #include <memory>
+#include <memory_resource>
 #include <openssl/crypto.h>
 #include <openssl/evp.h>
 #include <openssl/types.h>
 #include <ranges>
 #include <regex>
 #include <spdlog/spdlog.h>
-#include <sstream>
 #include <stdexcept>
+#include <unordered_set>
 #include <utility>
 #include <vdf_parser.hpp>
 #include <zip.h>
 #include <zipconf.h>
 
+#include "Arena.h"
 #include "Item.h"
+#include "LazyRegex.h"
+#include "OutputBuffer.h"
+#include "Parallel.h"
 #include "Settings.h"
 #include "Timer.h"
 #include "mods/Mod.h"
@@ -38,61 +47,282 @@ namespace fs = std::filesystem;
 namespace {
 constexpr auto APPID = "400750";
 
-namespace re {
-  // patterns for changing resupply values
-  const regex radius(R"(\{radius\s*\d+)");
-  const regex resupplyPeriod(R"(\{resupplyPeriod\s*\d+)");
-  const regex regenerationPeriod(R"(\{regenerationPeriod\s*\d+)");
-  const regex limit(R"(\{limit\s*\d+)");
-  const regex limitSpecial(R"(\{limit\s*%supply)");
-
-  const regex resupply(R"(\{resupply\r\n([\s\S]+?)\t+\}\r\n)");
+// longest time between two modifications that can result in the same file time, FAT uses 2 s
+constexpr chrono::seconds racyTimestampWindow{2};
 
+// patterns are compiled on first use, runs that do not need them do not pay for them
+namespace re {
   // patterns to use when replacing lines
-  const regex itemsLight(R"(\(define "items_light_\w+\"\r\n([\s\S]+?)\r\n\))");
-  const regex itemsHeavy(R"(\(define "items_heavy_\w+\"\r\n([\s\S]+?)\r\n\))");
-  const regex itemsMedic(R"(\(define "items_medic\w*\"\r\n([\s\S]+?)\r\n\))");
-  const regex itemsEngineer(R"(\(define "items_engineer"\r\n([\s\S]+?)\r\n\))");
-  const regex itemsExplosives(R"(\(define "items_explosives"\r\n([\s\S]+?)\r\n\))");
-  const regex resupplyItemsLight(R"(\("items_light(?!_all)\w{1,8}"\))");
-  const regex resupplyItemsHeavy(R"(\("items_heavy(?!_all)\w{1,8}"\))");
-  const regex resupplyItemsMedic(R"(\("items_medic(?!_all)\w{0,5}"\))");
+  constinit const LazyRegex itemsLight{R"(\(define "items_light_\w+\"\r\n([\s\S]+?)\r\n\))"};
+  constinit const LazyRegex itemsHeavy{R"(\(define "items_heavy_\w+\"\r\n([\s\S]+?)\r\n\))"};
+  constinit const LazyRegex itemsMedic{R"(\(define "items_medic\w*\"\r\n([\s\S]+?)\r\n\))"};
+  constinit const LazyRegex itemsEngineer{R"(\(define "items_engineer"\r\n([\s\S]+?)\r\n\))"};
+  constinit const LazyRegex itemsExplosives{R"(\(define "items_explosives"\r\n([\s\S]+?)\r\n\))"};
 
   // patterns to use when removing lines to prevent excessive amount of empty lines
-  const regex itemsLightRemove(R"(\w*\(define "items_light_\w+\"\r\n([\s\S]+?)\r\n\)(?:\r\n)+)");
-  const regex itemsHeavyRemove(R"(\w*\(define "items_heavy_\w+\"\r\n([\s\S]+?)\r\n\)(?:\r\n)+)");
-  const regex itemsMedicRemove(R"(\w*\(define "items_medic\w*\"\r\n([\s\S]+?)\r\n\)(?:\r\n)+)");
-  const regex itemsEngineerRemove(R"(\w*\(define "items_engineer"\r\n([\s\S]+?)\r\n\)(?:\r\n)+)");
-  const regex
-      itemsExplosivesRemove(R"(\w*\(define "items_explosives"\r\n([\s\S]+?)\r\n\)(?:\r\n)+)");
+  constinit const LazyRegex itemsLightRemove{
+      R"(\w*\(define "items_light_\w+\"\r\n([\s\S]+?)\r\n\)(?:\r\n)+)"};
+  constinit const LazyRegex itemsHeavyRemove{
+      R"(\w*\(define "items_heavy_\w+\"\r\n([\s\S]+?)\r\n\)(?:\r\n)+)"};
+  constinit const LazyRegex itemsMedicRemove{
+      R"(\w*\(define "items_medic\w*\"\r\n([\s\S]+?)\r\n\)(?:\r\n)+)"};
+  constinit const LazyRegex itemsEngineerRemove{
+      R"(\w*\(define "items_engineer"\r\n([\s\S]+?)\r\n\)(?:\r\n)+)"};
+  constinit const LazyRegex itemsExplosivesRemove{
+      R"(\w*\(define "items_explosives"\r\n([\s\S]+?)\r\n\)(?:\r\n)+)"};
 }  // namespace re
 
-struct itemData_t {
-  const string name;
-  const regex replace;
-  const regex remove;
-  vector<Item> items;
-
-  itemData_t() = delete;
-  itemData_t(string name, regex replace, regex remove)
-      : name(std::move(name)), replace(std::move(replace)), remove(std::move(remove)) {}
+struct itemCategory_t {
+  const char* name;
+  const LazyRegex& replace;
+  const LazyRegex& remove;
 };
 
-struct resupplyData_t {
-  const regex replace;
-  const string replaceWith;
+constexpr array itemCategories{
+    itemCategory_t{ "items_medic_all",      re::itemsMedic,      re::itemsMedicRemove},
+    itemCategory_t{ "items_light_all",      re::itemsLight,      re::itemsLightRemove},
+    itemCategory_t{ "items_heavy_all",      re::itemsHeavy,      re::itemsHeavyRemove},
+    itemCategory_t{  "items_engineer",   re::itemsEngineer,   re::itemsEngineerRemove},
+    itemCategory_t{"items_explosives", re::itemsExplosives, re::itemsExplosivesRemove},
+};
 
-  resupplyData_t() = delete;
-  resupplyData_t(regex replace, string replaceWith)
-      : replace(std::move(replace)), replaceWith(std::move(replaceWith)) {}
+/**
+ * @brief Reference to an item list inside a resupply block that is replaced by the merged list
+ */
+struct resupplyList_t {
+  string_view prefix;
+  size_t minLength;  // number of word characters following the prefix
+  size_t maxLength;
+  string_view replacement;
 };
 
-struct replacementData_t {
-  const size_t position;
-  const size_t length;
-  const string replacement;
+// matches the same references as \("items_light(?!_all)\w{1,8}"\),
+// \("items_heavy(?!_all)\w{1,8}"\) and \("items_medic(?!_all)\w{0,5}"\)
+constexpr array resupplyLists{
+    resupplyList_t{"(\"items_light", 1, 8, "(\"items_light_all\")"},
+    resupplyList_t{"(\"items_heavy", 1, 8, "(\"items_heavy_all\")"},
+    resupplyList_t{"(\"items_medic", 0, 5, "(\"items_medic_all\")"},
 };
 
+bool isWordChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+/**
+ * @brief Get the length of the list reference at the start of the text
+ * @return Length of the reference, 0 if the text does not start with a reference to the list
+ */
+size_t matchList(string_view text, const resupplyList_t& list) {
+  if (!text.starts_with(list.prefix)) {
+    return 0;
+  }
+  const string_view name = text.substr(list.prefix.size());
+  if (name.starts_with("_all")) {
+    return 0;
+  }
+
+  size_t length = 0;
+  while (length < name.size() && isWordChar(name[length])) {
+    length++;
+  }
+  if (length < list.minLength || length > list.maxLength || name.substr(length, 2) != "\")") {
+    return 0;
+  }
+  return list.prefix.size() + length + 2;
+}
+
+/**
+ * @brief Check if a line contains a setting, the same way as \{key\s*\d+ or \{key\s*value
+ * @param line Line to search
+ * @param key Setting including the opening brace, e.g. "{radius"
+ * @param value Value following the key, a number is expected if it is empty
+ */
+bool containsSetting(string_view line, string_view key, string_view value = {}) {
+  for (size_t pos = line.find(key); pos != string_view::npos; pos = line.find(key, pos + 1)) {
+    size_t begin = pos + key.size();
+    while (begin < line.size() && isspace(static_cast<unsigned char>(line[begin]))) {
+      begin++;
+    }
+    const string_view rest = line.substr(begin);
+    if (value.empty() ? !rest.empty() && isdigit(static_cast<unsigned char>(rest.front()))
+                      : rest.starts_with(value)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Find the end of a resupply block, the same way as ([\s\S]+?)\t+\}\r\n
+ * @param text Text following "{resupply\r\n"
+ * @return Length of the block contents and of the whole block including the closing brace, npos if
+ * the block is not closed
+ */
+pair<size_t, size_t> findResupplyEnd(string_view text) {
+  static constexpr string_view closing = "}\r\n";
+  for (size_t pos = text.find(closing); pos != string_view::npos;
+       pos        = text.find(closing, pos + 1)) {
+    // the contents are at least one character long and followed by at least one tab
+    size_t end = pos;
+    while (end > 1 && text[end - 1] == '\t') {
+      end--;
+    }
+    if (end < pos) {
+      return {end, pos + closing.size()};
+    }
+  }
+  return {string_view::npos, string_view::npos};
+}
+
+/**
+ * @brief Copy a text, the contents of every resupply block are passed to a function instead
+ * @param text Text to copy
+ * @param out Receives everything outside of the block contents
+ * @param f Function called with the contents of each block, in between the parts of the text
+ */
+template <typename F>
+void forEachResupplyBlock(string_view text, pmr::string& out, F&& f) {
+  static constexpr string_view opening = "{resupply\r\n";
+
+  size_t pos = 0;
+  for (size_t begin = text.find(opening); begin != string_view::npos;
+       begin        = text.find(opening, pos)) {
+    const size_t contentsBegin = begin + opening.size();
+    const auto [contentsLength, blockLength] = findResupplyEnd(text.substr(contentsBegin));
+    if (contentsLength == string_view::npos) {
+      break;
+    }
+    out.append(text.substr(pos, contentsBegin - pos));
+    f(text.substr(contentsBegin, contentsLength));
+    out.append(text.substr(contentsBegin + contentsLength, blockLength - contentsLength));
+    pos = contentsBegin + blockLength;
+  }
+  out.append(text.substr(pos));
+}
+
+/**
+ * @brief Call the provided function for each line of the provided text, excluding the '\n'
+ */
+template <typename F>
+void forEachLine(string_view text, F&& f) {
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find('\n', pos);
+    if (end == string_view::npos) {
+      end = text.size();
+    }
+    f(text.substr(pos, end - pos));
+    pos = end + 1;
+  }
+}
+
+/**
+ * @brief Replace a part of a string with a number without allocating a temporary string
+ */
+void replaceWithNumber(pmr::string& str, size_t offset, size_t size, int value) {
+  array<char, 16> buffer{};
+  auto [end, ec] = to_chars(buffer.begin(), buffer.end(), value);
+  str.replace(offset, size, buffer.data(), end - buffer.data());
+}
+
+template <typename T>
+void append(vector<char>& out, T value) {
+  const auto* bytes = reinterpret_cast<const char*>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+T take(span<const char>& in) noexcept(false) {
+  if (in.size() < sizeof(T)) {
+    throw runtime_error("unexpected end of item table");
+  }
+  T value;
+  memcpy(&value, in.data(), sizeof(T));
+  in = in.subspan(sizeof(T));
+  return value;
+}
+
+/**
+ * @brief Convert item lists to a compact binary representation
+ *
+ * Layout: string table (count, then length and characters of each string), then for every list
+ * the item count followed by the items. Items store indices into the string table for their
+ * strings and condition.
+ */
+vector<char> serializeItems(const pmr::vector<pmr::vector<Item>>& lists) {
+  vector<string_view> strings;
+  unordered_map<string_view, uint32_t> stringIndices;
+  auto intern = [&](string_view str) {
+    auto [it, inserted] = stringIndices.try_emplace(str, strings.size());
+    if (inserted) {
+      strings.push_back(str);
+    }
+    return it->second;
+  };
+
+  vector<char> items;
+  append(items, static_cast<uint32_t>(lists.size()));
+  for (const auto& list : lists) {
+    append(items, static_cast<uint32_t>(list.size()));
+    for (const auto& item : list) {
+      append(items, static_cast<uint32_t>(item.strings.size()));
+      for (const auto& str : item.strings) {
+        append(items, intern(str));
+      }
+      append(items, item.unknown);
+      append(items, item.value);
+      append(items, intern(item.condition));
+    }
+  }
+
+  vector<char> result;
+  append(result, static_cast<uint32_t>(strings.size()));
+  for (const auto& str : strings) {
+    append(result, static_cast<uint32_t>(str.size()));
+    result.append_range(str);
+  }
+  result.append_range(items);
+  return result;
+}
+
+/**
+ * @brief Restore item lists stored by serializeItems()
+ * @throw std::runtime_error If the data is invalid
+ */
+void deserializeItems(span<const char> in, pmr::vector<pmr::vector<Item>>& lists) noexcept(false) {
+  vector<string_view> strings(take<uint32_t>(in));
+  for (auto& str : strings) {
+    const auto length = take<uint32_t>(in);
+    if (in.size() < length) {
+      throw runtime_error("unexpected end of item table");
+    }
+    str = {in.data(), length};
+    in  = in.subspan(length);
+  }
+  auto stringAt = [&](uint32_t index) {
+    if (index >= strings.size()) {
+      throw runtime_error("invalid string index in item table");
+    }
+    return strings[index];
+  };
+
+  if (take<uint32_t>(in) != lists.size()) {
+    throw runtime_error("item table contains an unexpected number of lists");
+  }
+  for (auto& list : lists) {
+    list.resize(take<uint32_t>(in));
+    for (auto& item : list) {
+      item.strings.resize(take<uint32_t>(in));
+      for (auto& str : item.strings) {
+        str = stringAt(take<uint32_t>(in));
+      }
+      item.unknown   = take<int>(in);
+      item.value     = take<int>(in);
+      item.condition = stringAt(take<uint32_t>(in));
+    }
+  }
+}
+
 struct MdCtxDeleter {
   void operator()(EVP_MD_CTX* m) const {
     if (m) {
@@ -110,80 +340,321 @@ struct DigestDeleter {
   }
 };
 using DigestPtr = std::unique_ptr<unsigned char, DigestDeleter>;
+
+// files of all archives of a mod in the order of the extraction plan
+vector<fs::path> archiveFiles(const Mod& mod) {
+  vector<fs::path> files;
+  for (const auto& archive : mod.archives) {
+    files.insert(files.end(), archive.files.begin(), archive.files.end());
+  }
+  return files;
+}
 }  // namespace
 
-Patcher::Patcher(std::filesystem::path outputDir) noexcept(false)
-    : m_outputPath(std::move(outputDir)), m_gamePath(getGamePath()),
-      m_workshopPath(m_gamePath / "../../workshop/content/400750") {
+/**
+ * @brief Items of a single file, one list per item category
+ */
+struct Patcher::itemLists_t {
+  std::unique_ptr<Arena> arena = make_unique<Arena>("collectItems");
+  pmr::vector<pmr::vector<Item>> items =
+      pmr::vector<pmr::vector<Item>>(itemCategories.size(), arena.get());
+};
+
+Patcher::Patcher(std::filesystem::path outputDir, uint64_t cacheSize) noexcept(false)
+    : Patcher(std::move(outputDir), getGamePath(), cacheSize) {}
+
+Patcher::Patcher(std::filesystem::path outputDir, std::filesystem::path gamePath,
+                 uint64_t cacheSize) noexcept(false)
+    : m_gamePath(std::move(gamePath)), m_workshopPath(m_gamePath / "../../workshop/content/400750"),
+      m_archiveIndex(getCachePath() / "archives.idx"),
+      m_entryCache(getCachePath() / "entries", cacheSize) {
+  setOutputPath(std::move(outputDir));
+}
+
+void Patcher::setOutputPath(std::filesystem::path outputDir) noexcept(false) {
+  Timer t(__FUNCTION__);
+  m_outputPath = std::move(outputDir);
+  m_outputChecksums.clear();
+
   if (exists(m_outputPath)) {
     for (const auto& entry : fs::recursive_directory_iterator(m_outputPath)) {
       if (entry.is_directory()) {
         continue;
       }
-      m_outputChecksums[fs::relative(entry.path(), m_outputPath)] = sha256(entry.path());
+      m_outputChecksums[fs::relative(entry.path(), m_outputPath)] = cachedSha256(entry);
     }
   }
 }
 
-Patcher::~Patcher() noexcept {
+void Patcher::setSettings(const Settings& settings) noexcept {
+  m_settings = settings;
+}
+
+void Patcher::setDeduplication(bool enabled) {
+  if (!enabled) {
+    m_deduplicator.reset();
+  } else if (!m_deduplicator) {
+    m_deduplicator.emplace();
+  }
+}
+
+void Patcher::setJobs(unsigned jobs) noexcept {
+  m_jobs = jobs;
+}
+
+std::vector<std::filesystem::path> Patcher::changedFiles() const {
+  Timer t(__FUNCTION__);
+  vector<fs::path> changed;
+  if (!exists(m_outputPath)) {
+    return changed;
+  }
+
   for (const auto& entry : fs::recursive_directory_iterator(m_outputPath)) {
     if (entry.is_directory()) {
       continue;
     }
     fs::path relativePath = fs::relative(entry.path(), m_outputPath);
     try {
-      if (m_outputChecksums[relativePath] != sha256(entry.path())) {
-        cout << "\033[33m" << "contents of " << entry.path().string() << " have changed\033[0m\n";
+      const auto checksum = m_outputChecksums.find(relativePath);
+      if (checksum == m_outputChecksums.end() || checksum->second != cachedSha256(entry)) {
+        changed.push_back(std::move(relativePath));
       }
     } catch (const runtime_error& e) {
       spdlog::warn("Error checking for changes in file {}: {}", entry.path().string(), e.what());
     }
   }
+
+  ranges::sort(changed);
+  return changed;
 }
 
-void Patcher::patchVanilla() const noexcept(false) {
-  patchFileFromArchive(m_gamePath / "resource/properties.pak", "properties/resupply.inc");
+TaskGraph::TaskId Patcher::patchVanilla(TaskGraph& graph) const {
+  return patchFileFromArchive(graph, m_gamePath / "resource/properties.pak",
+                              "properties/resupply.inc", m_outputPath / "properties/resupply.inc");
 }
 
-void Patcher::patchMod(const Mod& mod) const noexcept(false) {
-  std::filesystem::path path = m_workshopPath / mod.workshopID / "resource";
+TaskGraph::TaskId Patcher::patchMod(TaskGraph& graph, const Mod& mod) const {
+  return patchMod(graph, mod, m_outputPath);
+}
+
+TaskGraph::TaskId Patcher::patchMod(TaskGraph& graph, const Mod& mod,
+                                    const std::filesystem::path& outputPath) const {
+  const fs::path path = m_workshopPath / mod.workshopID / "resource";
 
+  vector<TaskGraph::TaskId> saved;
   for (const auto& [archive, files] : mod.archives) {
-    for (const auto& file : files) {
-      patchFileFromArchive(path / archive, file);
-    }
+    saved.push_back(patchArchive(graph, path / archive, files, outputPath));
   }
   for (const auto& file : mod.files) {
-    patchFile(path / file, m_outputPath / file);
+    saved.push_back(patchFile(graph, path / file, outputPath / file));
+  }
+
+  return graph.add("patch "s + string(mod.name), [] {}, saved);
+}
+
+std::vector<ModData> Patcher::discoverMods() const {
+  Timer t(__FUNCTION__);
+
+  if (!fs::exists(m_workshopPath)) {
+    return {};
+  }
+
+  vector<fs::path> modPaths;
+  for (const auto& entry : fs::directory_iterator(m_workshopPath)) {
+    if (entry.is_directory()) {
+      modPaths.push_back(entry.path());
+    }
+  }
+  ranges::sort(modPaths);
+
+  // archive entries by workshop ID and archive, the index is updated in parallel
+  unordered_map<string, map<string, vector<string>>> archiveEntries;
+  for (const auto& pattern : resupplyPatterns) {
+    for (const auto& [archive, entry] : findInArchives("properties/"s + pattern)) {
+      // the index stores the paths below m_workshopPath, so no filesystem access is needed
+      const fs::path relativePath = archive.lexically_relative(m_workshopPath);
+      if (relativePath.empty() || *relativePath.begin() == "..") {
+        // vanilla archive
+        continue;
+      }
+      const string workshopID = relativePath.begin()->string();
+      const string archiveFile =
+          archive.lexically_relative(m_workshopPath / workshopID / "resource").generic_string();
+
+      archiveEntries[workshopID][archiveFile].push_back(entry.name);
+    }
+  }
+
+  // loose files
+  vector<vector<string>> files(modPaths.size());
+  parallelFor(modPaths.size(), m_jobs, [&](size_t i) {
+    const fs::path resourcePath   = modPaths[i] / "resource";
+    const fs::path propertiesPath = resourcePath / "properties";
+    if (!fs::is_directory(propertiesPath)) {
+      return;
+    }
+    for (const auto& entry : fs::directory_iterator(propertiesPath)) {
+      const string name = entry.path().filename().string();
+      if (entry.is_regular_file() && ranges::any_of(resupplyPatterns, [&](string_view pattern) {
+            return ArchiveIndex::matches(pattern, name);
+          })) {
+        files[i].push_back(entry.path().lexically_relative(resourcePath).generic_string());
+      }
+    }
+    ranges::sort(files[i]);
+  });
+
+  vector<ModData> result;
+  for (size_t i = 0; i < modPaths.size(); i++) {
+    const string workshopID = modPaths[i].filename().string();
+    auto& modArchives       = archiveEntries[workshopID];
+    for (auto& entries : modArchives | views::values) {
+      ranges::sort(entries);
+    }
+
+    // the game prefers loose files over archives and later archives over earlier ones, only the
+    // file it uses is patched so that every output file is written by a single task
+    unordered_set<string> used(files[i].begin(), files[i].end());
+    for (auto& entries : views::reverse(modArchives) | views::values) {
+      erase_if(entries, [&](const string& entry) {
+        return !used.insert(entry).second;
+      });
+    }
+    erase_if(modArchives, [](const auto& archive) {
+      return archive.second.empty();
+    });
+
+    if (modArchives.empty() && files[i].empty()) {
+      continue;
+    }
+
+    spdlog::info("found mod {} with {} archives and {} files", workshopID, modArchives.size(),
+                 files[i].size());
+    result.emplace_back(workshopID, workshopID, modArchives, files[i]);
+  }
+
+  return result;
+}
+
+TaskGraph::TaskId Patcher::patchDiscoveredMods(TaskGraph& graph) const noexcept(false) {
+  vector<TaskGraph::TaskId> patched;
+  for (const auto& data : discoverMods()) {
+    const Mod& mod = data.mod();
+    // a broken mod only skips its own remaining tasks
+    graph.beginGroup("mod "s + string(mod.workshopID));
+    patched.push_back(patchMod(graph, mod, m_outputPath / mod.workshopID));
+    graph.endGroup();
+  }
+  return graph.add("patch discovered mods", [] {}, patched);
+}
+
+TaskGraph::TaskId
+Patcher::removeResupplyRestrictions(TaskGraph& graph, const Mod& mod,
+                                    const std::vector<TaskGraph::TaskId>& dependencies) const {
+  return replaceResupply(graph, mod, {generateItemsAll(graph, mod, dependencies)});
+}
+
+std::vector<ArchiveIndex::Match> Patcher::findInArchives(std::string_view pattern) const {
+  Timer t(__FUNCTION__);
+  return m_archiveIndex.find(pattern);
+}
+
+std::shared_ptr<const MappedArchive>
+Patcher::mappedArchive(const std::filesystem::path& archive) const noexcept(false) {
+  lock_guard lock(m_mappedArchivesMutex);
+  auto& mapped = m_mappedArchives[archive];
+  if (!mapped || mapped->isOutdated(archive)) {
+    mapped = make_shared<const MappedArchive>(archive);
   }
+  return mapped;
 }
 
-void Patcher::removeResupplyRestrictions(const Mod& mod) const {
-  generateItemsAll(mod);
-  replaceResupply(mod);
+void Patcher::updateArchiveIndex() {
+  Timer t(__FUNCTION__);
+  vector directories{m_gamePath / "resource"};
+  if (fs::exists(m_workshopPath)) {
+    for (const auto& entry : fs::directory_iterator(m_workshopPath)) {
+      directories.push_back(entry.path() / "resource");
+    }
+  }
+  m_archiveIndex.update(directories, m_jobs);
 }
 
-std::vector<char>
-Patcher::loadFromArchive(const std::filesystem::path& archiveFile,
-                         const std::filesystem::path& fileToExtract) noexcept(false) {
+Patcher::fileData_t Patcher::loadFromArchive(const std::filesystem::path& archiveFile,
+                                             const std::filesystem::path& fileToExtract) const
+    noexcept(false) {
   Timer t(__FUNCTION__);
   spdlog::trace("loading from archive: {}", archiveFile.string());
-  if (!filesystem::exists(archiveFile)) {
-    throw runtime_error("File " + archiveFile.string() + " not found");
+
+  // read through a memory mapping of the archive, libzip is used for everything it cannot handle
+  fileData_t data;
+  try {
+    if (loadFromMappedArchive(mappedArchive(archiveFile), fileToExtract, data)) {
+      return data;
+    }
+  } catch (const runtime_error& e) {
+    spdlog::debug("reading {} with libzip: {}", archiveFile.string(), e.what());
+  }
+
+  data        = {};
+  data.buffer = loadWithLibzip(archiveFile, fileToExtract);
+  return data;
+}
+
+bool Patcher::loadFromMappedArchive(const std::shared_ptr<const MappedArchive>& archive,
+                                    const std::filesystem::path& fileToExtract,
+                                    fileData_t& data) const noexcept(false) {
+  const auto* entry = archive->find(fileToExtract.generic_string());
+  if (entry == nullptr) {
+    return false;
   }
 
-  // Open the archive
-  int err;
-  zip* z = zip_open(archiveFile.c_str(), ZIP_RDONLY, &err);
-  if (z == nullptr) {
-    zip_error_t error;
-    zip_error_init_with_code(&error, err);
+  // stored entries are used in place, caching them would only copy them
+  if (auto stored = archive->view(*entry)) {
+    data.archive = archive;
+    data.entry   = *stored;
+    spdlog::trace("stored");
+    return true;
+  }
 
-    const string errorString = "error opening archive: "s + zip_error_strerror(&error);
+  const EntryCache::key_t key{entry->crc, entry->uncompressedSize};
+  if (auto cached = m_entryCache.load(key, "data")) {
+    spdlog::trace("loaded from cache");
+    data.buffer = std::move(*cached);
+    return true;
+  }
+  auto extracted = archive->extract(*entry);
+  if (!extracted) {
+    return false;
+  }
+  m_entryCache.store(key, "data", *extracted);
+  spdlog::trace("success");
+  data.buffer = std::move(*extracted);
+  return true;
+}
 
-    zip_error_fini(&error);
+std::vector<char> Patcher::loadWithLibzip(const std::filesystem::path& archiveFile,
+                                          const std::filesystem::path& fileToExtract) const
+    noexcept(false) {
+  if (!filesystem::exists(archiveFile)) {
+    throw runtime_error("File " + archiveFile.string() + " not found");
+  }
 
-    throw runtime_error(errorString);
+  // Borrow a handle of the archive, other threads extract from it with their own handles
+  const ZipHandlePool::Handle handle = m_zipHandles.acquire(archiveFile);
+  zip_t* z                           = handle.get();
+
+  // Use the cached data if the entry has been extracted before
+  zip_stat_t stat;
+  zip_stat_init(&stat);
+  const bool hasKey = zip_stat(z, fileToExtract.c_str(), 0, &stat) == 0 &&
+                      (stat.valid & ZIP_STAT_CRC) && (stat.valid & ZIP_STAT_SIZE);
+  const EntryCache::key_t key{stat.crc, stat.size};
+  if (hasKey) {
+    if (auto cached = m_entryCache.load(key, "data")) {
+      spdlog::trace("loaded from cache");
+      return std::move(*cached);
+    }
   }
 
   // Open the compressed file
@@ -194,304 +665,459 @@ Patcher::loadFromArchive(const std::filesystem::path& archiveFile,
   }
 
   // Read the compressed file
-  vector<char> result(bufferSize);
-  zip_int64_t bytesRead = zip_fread(f, result.data(), bufferSize);
+  const size_t size = (stat.valid & ZIP_STAT_SIZE) ? stat.size : bufferSize;
+  vector<char> result(size);
+  zip_int64_t bytesRead = zip_fread(f, result.data(), size);
   if (bytesRead == -1) {
-    const auto e = zip_get_error(z);
-    throw runtime_error("zip_fread() failed, "s + zip_error_strerror(e));
+    const string error = zip_error_strerror(zip_file_get_error(f));
+    zip_fclose(f);
+    throw runtime_error("zip_fread() failed, " + error);
   }
 
   zip_fclose(f);
-  zip_close(z);
 
   result.resize(bytesRead);
 
+  if (hasKey) {
+    m_entryCache.store(key, "data", result);
+  }
+
   spdlog::trace("success");
   return result;
 }
 
-std::vector<char> Patcher::loadFromFile(const std::filesystem::path& file) noexcept(false) {
+Patcher::fileData_t Patcher::loadFromFile(const std::filesystem::path& file) noexcept(false) {
   Timer t(__FUNCTION__);
   spdlog::debug("loading from file: {}", file.string());
 
+  fileData_t data;
+  try {
+    data.mapping.emplace(file, MappedFile::Access::sequential);
+    spdlog::trace("mapped {} bytes", data.mapping->data().size());
+    return data;
+  } catch (const runtime_error& e) {
+    spdlog::debug("reading instead of mapping: {}", e.what());
+  }
+
   if (!filesystem::exists(file)) {
     throw runtime_error("File " + file.string() + " not found");
   }
 
-  ifstream in(file);
+  ifstream in(file, ios::binary);
   in.exceptions(ios::failbit | ios::badbit);
   spdlog::trace("file opened");
 
   size_t size = filesystem::file_size(file);
-  vector<char> data(size);
+  data.buffer.resize(size);
 
-  in.read(data.data(), size);
+  in.read(data.buffer.data(), size);
 
   spdlog::trace("read {} bytes", size);
   return data;
 }
 
-void Patcher::patch(std::vector<char>& data) noexcept(false) {
+std::vector<char> Patcher::patch(std::span<const char> data,
+                                 const Settings& settings) noexcept(false) {
   Timer t(__FUNCTION__);
   spdlog::trace("patching");
-  istringstream iss(data.data());
+  Arena arena(__FUNCTION__);
   vector<char> out;
   out.reserve(data.size());
 
-  string line;
+  pmr::string line(&arena);
+
+  // the traces of every modified line are only compiled in with RESUPPLY_PATCHER_LOG_LEVEL=TRACE
+  forEachLine({data.data(), data.size()}, [&](string_view input) {
+    line.assign(input);
 
-  while (getline(iss, line)) {
     // remove trailing '\r'
     if (line.ends_with('\r')) {
       // spdlog::trace("removing trailing \\r");
       line.pop_back();
     }
 
-    // using strings instead of regex would be much faster,
-    // but as this function only takes a few milliseconds, the practical benefit of any optimization
-    // is negligible
-    if (regex_search(line, regex(re::radius))) {
+    // the settings are matched by hand, std::regex allocates on every search
+    if (containsSetting(line, "{radius")) {
       // radius
-      spdlog::trace("modifying radius");
-      multiplyNumberInString(line, Settings::defaults::radiusMultiplier);
-    } else if (regex_search(line, regex(re::resupplyPeriod))) {
+      SPDLOG_TRACE("modifying radius");
+      multiplyNumberInString(line, settings.radiusMultiplier);
+    } else if (containsSetting(line, "{resupplyPeriod")) {
       // resupply period
-      spdlog::trace("modifying resupply period");
-      replaceNumberInString(line, Settings::defaults::resupplyPeriod);
-    } else if (regex_search(line, regex(re::regenerationPeriod))) {
+      SPDLOG_TRACE("modifying resupply period");
+      replaceNumberInString(line, settings.resupplyPeriod);
+    } else if (containsSetting(line, "{regenerationPeriod")) {
       // regeneration period
-      spdlog::trace("modifying regeneration period");
-      replaceNumberInString(line, Settings::defaults::regenerationPeriod);
-    } else if (regex_search(line, regex(re::limit))) {
+      SPDLOG_TRACE("modifying regeneration period");
+      replaceNumberInString(line, settings.regenerationPeriod);
+    } else if (containsSetting(line, "{limit")) {
       // limit
-      spdlog::trace("modifying limit");
-      multiplyNumberInString(line, Settings::defaults::limitMultiplier);
-    } else if (regex_search(line, regex(re::limitSpecial))) {
+      SPDLOG_TRACE("modifying limit");
+      multiplyNumberInString(line, settings.limitMultiplier);
+    } else if (containsSetting(line, "{limit", "%supply")) {
       // limit, value is "%supply" instead of an integer
-      spdlog::trace("modifying limit %supply");
-      static constexpr string stringToReplace = "%supply";
-      line.replace(line.find(stringToReplace), stringToReplace.size(),
-                   to_string(Settings::defaults::limitFallback));
+      SPDLOG_TRACE("modifying limit %supply");
+      static constexpr string_view stringToReplace = "%supply";
+      replaceWithNumber(line, line.find(stringToReplace), stringToReplace.size(),
+                        settings.limitFallback);
     }
 
     // rtrim(line);
     line.append("\r\n");
     out.append_range(line);
-  }
+  });
 
-  swap(data, out);
+  return out;
 }
 
-void Patcher::patchFileFromArchive(const std::filesystem::path& archiveFile,
-                                   const std::filesystem::path& fileToExtract) const
-    noexcept(false) {
-  vector<char> data = loadFromArchive(archiveFile, fileToExtract);
-  patch(data);
-
-  fs::path targetFile = m_outputPath / fileToExtract;
-
-  saveToFile(data, targetFile);
+TaskGraph::TaskId
+Patcher::patchFileFromArchive(TaskGraph& graph, const std::filesystem::path& archiveFile,
+                              const std::filesystem::path& fileToExtract,
+                              const std::filesystem::path& outputFile) const noexcept(false) {
+  auto data = make_shared<fileData_t>();
+  const TaskGraph::TaskId extracted =
+      graph.add("extract " + fileToExtract.string(), [this, data, archiveFile, fileToExtract] {
+        *data = loadFromArchive(archiveFile, fileToExtract);
+      });
+  return patchData(graph, data, outputFile, extracted);
 }
 
-void Patcher::patchFile(const std::filesystem::path& inputFile,
-                        const std::filesystem::path& outputFile) const noexcept(false) {
-  vector<char> data = loadFromFile(inputFile);
-  patch(data);
+TaskGraph::TaskId Patcher::patchArchive(TaskGraph& graph, const std::filesystem::path& archiveFile,
+                                        std::span<const std::string_view> files,
+                                        const std::filesystem::path& outputPath) const
+    noexcept(false) {
+  // the archive is mapped once, its files are then extracted in parallel
+  auto archive = make_shared<shared_ptr<const MappedArchive>>();
+  const TaskGraph::TaskId opened =
+      graph.add("open " + archiveFile.string(), [this, archive, archiveFile] {
+        try {
+          *archive = mappedArchive(archiveFile);
+        } catch (const runtime_error& e) {
+          spdlog::debug("reading {} with libzip: {}", archiveFile.string(), e.what());
+        }
+      });
+
+  vector<TaskGraph::TaskId> saved;
+  for (const fs::path file : files) {
+    auto data = make_shared<fileData_t>();
+    const TaskGraph::TaskId extracted = graph.add(
+        "extract " + file.string(),
+        [this, archive, data, archiveFile, file] {
+          // libzip is used for everything the mapped archive cannot handle
+          try {
+            if (*archive && loadFromMappedArchive(*archive, file, *data)) {
+              return;
+            }
+          } catch (const runtime_error& e) {
+            spdlog::debug("reading {} with libzip: {}", file.string(), e.what());
+          }
+          *data        = {};
+          data->buffer = loadWithLibzip(archiveFile, file);
+        },
+        {opened});
+    saved.push_back(patchData(graph, data, outputPath / file, extracted));
+  }
 
-  saveToFile(data, outputFile);
+  return graph.add("patch " + archiveFile.string(), [] {}, saved);
 }
 
-void Patcher::generateItemsAll(const Mod& mod) const {
-  Timer t(__FUNCTION__);
+TaskGraph::TaskId Patcher::patchFile(TaskGraph& graph, const std::filesystem::path& inputFile,
+                                     const std::filesystem::path& outputFile) const
+    noexcept(false) {
+  auto data = make_shared<fileData_t>();
+  const TaskGraph::TaskId loaded = graph.add("load " + inputFile.string(), [data, inputFile] {
+    *data = loadFromFile(inputFile);
+  });
+  return patchData(graph, data, outputFile, loaded);
+}
 
-  array itemData{
-      itemData_t{ "items_medic_all",      re::itemsMedic,      re::itemsMedicRemove},
-      itemData_t{ "items_light_all",      re::itemsLight,      re::itemsLightRemove},
-      itemData_t{ "items_heavy_all",      re::itemsHeavy,      re::itemsHeavyRemove},
-      itemData_t{  "items_engineer",   re::itemsEngineer,   re::itemsEngineerRemove},
-      itemData_t{"items_explosives", re::itemsExplosives, re::itemsExplosivesRemove},
-  };
+TaskGraph::TaskId Patcher::patchData(TaskGraph& graph, std::shared_ptr<fileData_t> data,
+                                     const std::filesystem::path& outputFile,
+                                     TaskGraph::TaskId loaded) const noexcept(false) {
+  const TaskGraph::TaskId patched = graph.add(
+      "patch " + outputFile.string(),
+      [data, settings = m_settings] {
+        vector<char> patched = patch(data->view(), settings);
+        // the input is no longer needed once it has been patched
+        *data        = {};
+        data->buffer = std::move(patched);
+      },
+      {loaded});
+  return graph.add(
+      "write " + outputFile.string(),
+      [this, data, outputFile] {
+        saveToFile(data->buffer, outputFile);
+        // the buffer is no longer needed
+        *data = {};
+      },
+      {patched});
+}
 
-  for (const auto& archive : mod.archives) {
-    string content = readFileToString(m_outputPath / archive.files.front());
-
-    // extract item data
-    for (auto& entry : itemData) {
-      auto begin = sregex_iterator(content.begin(), content.end(), entry.replace);
-      auto end   = sregex_iterator();
-
-      for (sregex_iterator i = begin; i != end; ++i) {
-        string res = i->str(1);
-        istringstream iss(res);
-        string line;
-        string condition;
-
-        while (getline(iss, line)) {
-          trim(line);
-          if (line.starts_with("{item")) {
-            Item item;
-            istringstream itemStream(line);
-            itemStream >> item;
-            if (!condition.empty()) {
-              item.condition = condition;
-              condition.clear();
-            }
-            entry.items.push_back(item);
-          } else if (line.starts_with('(')) {
-            condition = line;
-          }
-        }
-      }
-    }
+TaskGraph::TaskId
+Patcher::generateItemsAll(TaskGraph& graph, const Mod& mod,
+                          const std::vector<TaskGraph::TaskId>& dependencies) const {
+  const vector<fs::path> files = archiveFiles(mod);
+
+  // items are collected per file and merged in the order of the archives to get the same result
+  // regardless of the order the tasks are executed in
+  auto items = make_shared<vector<itemLists_t>>(files.size());
+
+  vector<TaskGraph::TaskId> collected;
+  for (size_t i = 0; i < files.size(); i++) {
+    const fs::path file = m_outputPath / files[i];
+    collected.push_back(graph.add(
+        "collect items from " + file.string(),
+        [this, items, i, file] {
+          collectItems(file, (*items)[i]);
+        },
+        dependencies));
   }
 
-  // sort
-  for (auto& entry : itemData) {
-    ranges::sort(entry.items, [](const Item& lhs, const Item& rhs) {
-      return lhs.strings < rhs.strings;
-    });
+  vector<TaskGraph::TaskId> done;
+  for (size_t category = 0; category < itemCategories.size(); category++) {
+    const fs::path file = m_outputPath / "properties" / (itemCategories[category].name + ".inc"s);
+    done.push_back(graph.add(
+        "write " + file.string(),
+        [this, items, category, file] {
+          saveItems(category, *items, file);
+        },
+        collected));
   }
 
-  // remove duplicates
-  auto duplicateComp = [](const Item& lhs, const Item& rhs) {
-    return lhs.strings == rhs.strings && lhs.condition == rhs.condition;
-  };
-  for (auto& entry : itemData) {
-    entry.items.erase(ranges::unique(entry.items, duplicateComp).begin(), entry.items.end());
+  for (size_t i = 0; i < files.size(); i++) {
+    const fs::path file = m_outputPath / files[i];
+    done.push_back(graph.add(
+        "rewrite " + file.string(),
+        [this, file] {
+          removeItems(file);
+        },
+        {collected[i]}));
   }
 
-  // save item data
-  for (auto& entry : itemData) {
-    ofstream out(m_outputPath / "properties" / (entry.name + ".inc"));
-    out.exceptions(ios::failbit | ios::badbit);
-    out << "(define \"" << entry.name << "\"\r\n";
-    for (const auto& item : entry.items) {
-      out << item << "\r\n";
-    }
+  return graph.add("generate items for "s + string(mod.name), [] {}, done);
+}
 
-    out << ")\r\n";
+TaskGraph::TaskId
+Patcher::replaceResupply(TaskGraph& graph, const Mod& mod,
+                         const std::vector<TaskGraph::TaskId>& dependencies) const {
+  vector<TaskGraph::TaskId> done;
+  for (const auto& archiveFile : archiveFiles(mod)) {
+    const fs::path file = m_outputPath / archiveFile;
+    done.push_back(graph.add(
+        "replace resupply in " + file.string(),
+        [this, file] {
+          replaceResupply(file);
+        },
+        dependencies));
   }
 
-  // delete items from files
-  for (const auto& archive : mod.archives) {
-    fs::path file = m_outputPath / archive.files.front();
+  return graph.add("replace resupply for "s + string(mod.name), [] {}, done);
+}
 
-    ifstream in(file);
-    in.exceptions(ios::failbit | ios::badbit);
-    auto size = fs::file_size(file);
-    vector<char> data(size);
-    in.read(data.data(), size);
-    in.close();
+void Patcher::collectItems(const std::filesystem::path& file, itemLists_t& lists) const
+    noexcept(false) {
+  // the items are parsed from the mapped file, only the parsed strings are copied into the arena
+  const fileData_t data          = loadFromFile(file);
+  const span<const char> content = data.view();
+
+  // The items only depend on the content of the patched file, so files with the same content have
+  // the same items. The key of the archive entry would not be enough: the patched file also
+  // depends on the settings, and a file rewritten by an earlier pass has no archive entry.
+  const EntryCache::key_t key = EntryCache::keyOf(content);
+  if (auto cached = m_entryCache.load(key, "items")) {
+    try {
+      deserializeItems(*cached, lists.items);
+      return;
+    } catch (const runtime_error& e) {
+      spdlog::warn("ignoring cached items of {}: {}", file.string(), e.what());
+      for (auto& items : lists.items) {
+        items.clear();
+      }
+    }
+  }
 
-    // create string for regex
-    string content(data.begin(), data.end());
+  for (size_t category = 0; category < itemCategories.size(); category++) {
+    auto& items = lists.items[category];
 
-    for (const auto& entry : itemData) {
-      // replace first instance
-      content = regex_replace(content, entry.replace, "(include \"" + entry.name + ".inc\")",
-                              regex_constants::format_first_only);
-      // remove all others
-      content = regex_replace(content, entry.remove, "");
-    }
+    const regex& pattern = itemCategories[category].replace.get();
+    auto begin = cregex_iterator(content.data(), content.data() + content.size(), pattern);
+    auto end   = cregex_iterator();
 
-    // replace data
-    data.clear();
-    data.insert_range(data.begin(), content);
+    for (cregex_iterator i = begin; i != end; ++i) {
+      string_view condition;
 
-    // write data to file
-    ofstream out(file);
-    out.exceptions(ios::failbit | ios::badbit);
-    out.write(data.data(), data.size());
+      forEachLine(string_view((*i)[1].first, (*i)[1].second), [&](string_view line) {
+        line = trim(line);
+        if (line.starts_with("{item")) {
+          Item& item = items.emplace_back(Item::parse(line, items.get_allocator()));
+          if (!condition.empty()) {
+            item.condition = condition;
+            condition      = {};
+          }
+        } else if (line.starts_with('(')) {
+          condition = line;
+        }
+      });
+    }
   }
-}
-
-void Patcher::replaceResupply(const Mod& mod) const {
-  Timer t(__FUNCTION__);
 
-  const array resupplies{
-      resupplyData_t{re::resupplyItemsLight, "(\"items_light_all\")"},
-      resupplyData_t{re::resupplyItemsHeavy, "(\"items_heavy_all\")"},
-      resupplyData_t{re::resupplyItemsMedic, "(\"items_medic_all\")"}
-  };
+  m_entryCache.store(key, "items", serializeItems(lists.items));
+}
 
-  for (const auto& archive : mod.archives) {
-    fs::path file      = m_outputPath / archive.files.front();
-    string fileContent = readFileToString(file);
+void Patcher::saveItems(size_t category, std::span<const itemLists_t> lists,
+                        const std::filesystem::path& file) const noexcept(false) {
+  Arena arena(__FUNCTION__ + " "s + file.string());
 
-    vector<replacementData_t> replacements;
+  pmr::vector<Item> items(&arena);
+  for (const auto& list : lists) {
+    items.insert(items.end(), list.items[category].begin(), list.items[category].end());
+  }
 
-    auto begin = sregex_iterator(fileContent.begin(), fileContent.end(), re::resupply);
-    auto end   = sregex_iterator();
+  // sort
+  ranges::sort(items, [](const Item& lhs, const Item& rhs) {
+    return lhs.strings < rhs.strings;
+  });
 
-    for (sregex_iterator i = begin; i != end; ++i) {
-      string result = i->str(1);
-      for (const auto& [replace, replaceWith] : resupplies) {
-        // replace first instance
-        result = regex_replace(result, replace, replaceWith, regex_constants::format_first_only);
-        // remove all others
-        result = regex_replace(result, replace, "");
-      }
+  // remove duplicates
+  auto duplicateComp = [](const Item& lhs, const Item& rhs) {
+    return lhs.strings == rhs.strings && lhs.condition == rhs.condition;
+  };
+  items.erase(ranges::unique(items, duplicateComp).begin(), items.end());
 
-      // save replacement data
-      replacements.push_back(
-          {static_cast<size_t>(i->position(1)), static_cast<size_t>(i->length(1)), result});
-    }
+  // save item data
+  size_t size = 64;
+  for (const auto& item : items) {
+    size += OutputBuffer::estimateSize(item);
+  }
 
-    // replace strings from end to beginning to not invalidate the stored offsets
-    for (const auto& replacement : std::ranges::reverse_view(replacements)) {
-      fileContent.replace(replacement.position, replacement.length, replacement.replacement);
-    }
+  OutputBuffer out(size);
+  out.beginDefine(itemCategories[category].name);
+  for (const auto& item : items) {
+    out.item(item);
+  }
+  out.endDefine();
 
-    // clean up empty lines
-    replacements.clear();
-    begin = sregex_iterator(fileContent.begin(), fileContent.end(), re::resupply);
-    end   = sregex_iterator();
+  saveToFile(out.data(), file);
+}
 
-    for (sregex_iterator i = begin; i != end; ++i) {
-      string result = i->str(1);
-      istringstream iss(result);
-      string line;
+void Patcher::removeItems(const std::filesystem::path& file) const noexcept(false) {
+  Arena arena(__FUNCTION__ + " "s + file.string());
+
+  // the first replacement reads the mapped file, every later one the result of the previous one
+  fileData_t data = loadFromFile(file);
+  string_view source(data.view().data(), data.view().size());
+  pmr::string content(&arena);
+  pmr::string buffer(&arena);
+  content.reserve(source.size());
+  buffer.reserve(source.size());
+
+  for (const auto& category : itemCategories) {
+    const string include = "(include \""s + category.name + ".inc\")";
+    // replace first instance
+    buffer.clear();
+    regex_replace(back_inserter(buffer), source.begin(), source.end(), category.replace.get(),
+                  include, regex_constants::format_first_only);
+    swap(content, buffer);
+    source = content;
+    // remove all others
+    buffer.clear();
+    regex_replace(back_inserter(buffer), source.begin(), source.end(), category.remove.get(), "");
+    swap(content, buffer);
+    source = content;
+  }
 
-      string replacement;
+  // the file is replaced, the mapping must not be used afterwards
+  data = {};
 
-      auto pred = [](char c) {
-        return isspace(c);
-      };
+  // write data to file
+  saveToFile(content, file);
+}
 
-      while (getline(iss, line)) {
-        if (!ranges::all_of(line, pred)) {
-          rtrim(line);
-          replacement.append(line + "\r\n");
+void Patcher::replaceResupply(const std::filesystem::path& file) const noexcept(false) {
+  Arena arena(__FUNCTION__ + " "s + file.string());
+
+  fileData_t data = loadFromFile(file);
+  const string_view content(data.view().data(), data.view().size());
+
+  // Replace the first reference to each list with the merged list and remove all others, one list
+  // after the other: removing a reference can complete a reference to a later list.
+  pmr::string replaced(&arena);
+  replaced.reserve(content.size());
+  pmr::string contents(&arena);
+  pmr::string buffer(&arena);
+  forEachResupplyBlock(content, replaced, [&](string_view input) {
+    contents.assign(input);
+    for (const auto& list : resupplyLists) {
+      const string_view text = contents;
+      buffer.clear();
+      bool found = false;
+      for (size_t i = 0; i < text.size();) {
+        const size_t length = text[i] == '(' ? matchList(text.substr(i), list) : 0;
+        if (length == 0) {
+          buffer.push_back(text[i++]);
+          continue;
         }
+        if (!found) {
+          buffer.append(list.replacement);
+          found = true;
+        }
+        i += length;
       }
-      replacements.push_back(
-          {static_cast<size_t>(i->position(1)), static_cast<size_t>(i->length(1)), replacement});
-    }
-
-    // replace strings from end to beginning to not invalidate the stored offsets
-    for (const auto& replacement : std::ranges::reverse_view(replacements)) {
-      fileContent.replace(replacement.position, replacement.length, replacement.replacement);
+      swap(contents, buffer);
     }
+    replaced.append(contents);
+  });
+
+  // the file is replaced, the mapping must not be used afterwards
+  data = {};
+
+  // Drop the lines that are empty now. The blocks are searched again: a removed reference in front
+  // of the closing brace leaves tabs that become part of it, like the second regex pass did.
+  pmr::string out(&arena);
+  out.reserve(replaced.size());
+  forEachResupplyBlock(replaced, out, [&](string_view input) {
+    forEachLine(input, [&](string_view line) {
+      if (!ranges::all_of(line, [](char c) {
+            return isspace(c);
+          })) {
+        out.append(rtrim(line)).append("\r\n");
+      }
+    });
+  });
 
-    // save file
-    saveToFile({fileContent.begin(), fileContent.end()}, file);
-  }
-}
-
-std::string Patcher::readFileToString(const std::filesystem::path& file) noexcept(false) {
-  vector<char> data = loadFromFile(file);
-  return {data.begin(), data.end()};
+  // save file
+  saveToFile(out, file);
 }
 
-void Patcher::saveToFile(const std::vector<char>& data,
-                         const std::filesystem::path& file) noexcept(false) {
+void Patcher::saveToFile(std::span<const char> data, const std::filesystem::path& file) const
+    noexcept(false) {
   Timer t(__FUNCTION__);
   spdlog::trace("saving to file: {}", file.string());
 
   fs::create_directories(file.parent_path());
-  ofstream out(file);
-  out.exceptions(ios::failbit | ios::badbit);
-  out.write(data.data(), data.size());
+
+  // a hard link created by deduplication is replaced, writing to it would change the other files
+  error_code ec;
+  if (fs::hard_link_count(file, ec) > 1 && !ec) {
+    fs::remove(file);
+  }
+
+  FileDeduplicator::key_t key;
+  if (m_deduplicator) {
+    key = FileDeduplicator::keyOf(data);
+    if (m_deduplicator->share(key, file)) {
+      return;
+    }
+  }
+
+  {
+    ofstream out(file, ios::binary);
+    out.exceptions(ios::failbit | ios::badbit);
+    out.write(data.data(), data.size());
+  }
+
+  if (m_deduplicator) {
+    m_deduplicator->add(key, file);
+  }
 }
 
 std::filesystem::path Patcher::getGamePath() noexcept(false) {
@@ -541,40 +1167,53 @@ std::filesystem::path Patcher::getSteamPath() noexcept(false) {
   throw runtime_error("Could not find Steam installation");
 }
 
-Patcher::data_t Patcher::extractNumberFromString(const std::string& line) noexcept(false) {
+std::filesystem::path Patcher::getCachePath() noexcept {
+  if (const char* cacheHome = getenv("XDG_CACHE_HOME"); cacheHome != nullptr && *cacheHome) {
+    return fs::path(cacheHome) / "resupply_patcher";
+  }
+  return fs::path(getenv("HOME")) / ".cache/resupply_patcher";
+}
+
+Patcher::data_t Patcher::extractNumberFromString(std::string_view line) noexcept(false) {
   size_t firstDigit = line.find_first_of("0123456789");
   if (firstDigit == string::npos) {
     throw runtime_error("Failed to find digit");
   }
 
   size_t numberLength = 0;
-  while (isdigit(line[firstDigit + numberLength])) {
+  while (firstDigit + numberLength < line.size() && isdigit(line[firstDigit + numberLength])) {
     numberLength++;
   }
 
-  string numberString = line.substr(firstDigit, numberLength);
+  string_view numberString = line.substr(firstDigit, numberLength);
+
+  SPDLOG_TRACE("found number: {}", numberString);
 
-  spdlog::trace("found number: {}", numberString);
+  int number;
+  auto [ptr, ec] = from_chars(numberString.data(), numberString.data() + numberLength, number);
+  if (ec != errc{}) {
+    throw runtime_error("Failed to parse number " + string(numberString));
+  }
 
-  return {firstDigit, numberLength, stoi(numberString)};
+  return {firstDigit, numberLength, number};
 }
 
-void Patcher::multiplyNumberInString(std::string& line, int multiplier) noexcept(false) {
-  spdlog::trace("multiplying number in string '{}' with {}", line, multiplier);
+void Patcher::multiplyNumberInString(std::pmr::string& line, int multiplier) noexcept(false) {
+  SPDLOG_TRACE("multiplying number in string '{}' with {}", line, multiplier);
 
   auto [offset, size, number] = extractNumberFromString(line);
-  line.replace(offset, size, to_string(number * multiplier));
+  replaceWithNumber(line, offset, size, number * multiplier);
 
-  spdlog::trace("replaced number {} with {}", number, number * multiplier);
+  SPDLOG_TRACE("replaced number {} with {}", number, number * multiplier);
 }
 
-void Patcher::replaceNumberInString(std::string& line, int newValue) noexcept(false) {
-  spdlog::trace("replacing number in string '{}' with {}", line, newValue);
+void Patcher::replaceNumberInString(std::pmr::string& line, int newValue) noexcept(false) {
+  SPDLOG_TRACE("replacing number in string '{}' with {}", line, newValue);
 
   auto [offset, size, number] = extractNumberFromString(line);
-  line.replace(offset, size, to_string(newValue));
+  replaceWithNumber(line, offset, size, newValue);
 
-  spdlog::trace("replaced number {} with {}", number, newValue);
+  SPDLOG_TRACE("replaced number {} with {}", number, newValue);
 }
 
 sha256sum Patcher::sha256(const std::filesystem::path& file) noexcept(false) {
@@ -627,22 +1266,40 @@ sha256sum Patcher::sha256(const std::filesystem::path& file) noexcept(false) {
   return checksum;
 }
 
-void Patcher::ltrim(std::string& line) noexcept {
-  line.erase(line.begin(), ranges::find_if(line, [](char c) {
-               return !isspace(c);
-             }));
+sha256sum Patcher::cachedSha256(const std::filesystem::directory_entry& file) const
+    noexcept(false) {
+  const auto mtime = file.last_write_time();
+  const auto size  = file.file_size();
+
+  // Timestamps are coarse, a file modified shortly before it was hashed can be written again with
+  // the same time and size. Like git, such racy checksums are not trusted and calculated again.
+  auto& cached    = m_checksumCache[fs::absolute(file.path())];
+  const bool racy = cached.mtime + racyTimestampWindow >= cached.hashed;
+  if (racy || cached.mtime != mtime || cached.size != size) {
+    const auto hashed = fs::file_time_type::clock::now();
+    cached            = {mtime, size, hashed, sha256(file.path())};
+  }
+  return cached.sum;
+}
+
+std::string_view Patcher::ltrim(std::string_view line) noexcept {
+  line.remove_prefix(ranges::find_if(line,
+                                     [](char c) {
+                                       return !isspace(c);
+                                     }) -
+                     line.begin());
+  return line;
 }
 
-void Patcher::rtrim(std::string& line) noexcept {
-  line.erase(find_if(line.rbegin(), line.rend(),
-                     [](char c) {
-                       return !isspace(c);
-                     })
-                 .base(),
-             line.end());
+std::string_view Patcher::rtrim(std::string_view line) noexcept {
+  line.remove_suffix(find_if(line.rbegin(), line.rend(),
+                             [](char c) {
+                               return !isspace(c);
+                             }) -
+                     line.rbegin());
+  return line;
 }
 
-void Patcher::trim(std::string& line) noexcept {
-  ltrim(line);
-  rtrim(line);
+std::string_view Patcher::trim(std::string_view line) noexcept {
+  return rtrim(ltrim(line));
 }
@@ -3,85 +3,231 @@
 #include <array>
 #include <cstddef>
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
-class Mod;
+#include "ArchiveIndex.h"
+#include "EntryCache.h"
+#include "FileDeduplicator.h"
+#include "MappedArchive.h"
+#include "MappedFile.h"
+#include "Settings.h"
+#include "TaskGraph.h"
+#include "ZipHandlePool.h"
+#include "mods/Mod.h"
+
 
 using sha256sum = std::array<char, 32>;
 
 class Patcher {
 public:
+  static constexpr uint64_t defaultCacheSize = 256 * 1024 * 1024;
+
   /**
+   * @param outputDir Output directory
+   * @param cacheSize Maximum size of the cache of extracted and parsed files, 0 disables it
    * @throw std::runtime_error When the game directory cannot be found
    */
-  explicit Patcher(std::filesystem::path outputDir) noexcept(false);
+  explicit Patcher(std::filesystem::path outputDir,
+                   uint64_t cacheSize = defaultCacheSize) noexcept(false);
 
-  ~Patcher() noexcept;
+  /**
+   * @param outputDir Output directory
+   * @param gamePath Game directory, workshop mods are expected relative to it
+   * @param cacheSize Maximum size of the cache of extracted and parsed files, 0 disables it
+   */
+  Patcher(std::filesystem::path outputDir, std::filesystem::path gamePath,
+          uint64_t cacheSize) noexcept(false);
 
   /**
-   * @brief Patch vanilla resupply values
+   * @brief Change the output directory and record the checksums of the files it contains
+   * @note Checksums are reused for files whose modification time and size have not changed since
+   * an earlier call or changedFiles()
    * @throw std::runtime_error
    */
-  void patchVanilla() const noexcept(false);
+  void setOutputPath(std::filesystem::path outputDir) noexcept(false);
+
+  const std::filesystem::path& outputPath() const noexcept { return m_outputPath; }
 
   /**
-   * @brief Patch resupply values a mod
+   * @brief Change the values used when patching files, used by tasks added afterwards
+   */
+  void setSettings(const Settings& settings) noexcept;
+
+  /**
+   * @brief Share the storage of identical output files instead of writing every copy
+   * @note Shared files are hard links on filesystems without reflinks, modifying one of them
+   * outside of the patcher modifies all of them
+   */
+  void setDeduplication(bool enabled);
+
+  /**
+   * @brief Change the number of threads used to scan mods and archives outside of task graphs
+   */
+  void setJobs(unsigned jobs) noexcept;
+
+  /**
+   * @brief Get the files in the output directory that are new or have been modified since the
+   * output directory has been set
+   * @return Paths relative to the output directory
+   */
+  std::vector<std::filesystem::path> changedFiles() const;
+
+  /**
+   * @brief Add tasks patching vanilla resupply values
+   * @return Task that finishes after all files have been saved
+   */
+  TaskGraph::TaskId patchVanilla(TaskGraph& graph) const;
+
+  /**
+   * @brief Add tasks patching resupply values of a mod
+   * @param graph Graph to add the tasks to
    * @param mod Mod to patch
+   * @return Task that finishes after all files have been saved
+   */
+  TaskGraph::TaskId patchMod(TaskGraph& graph, const Mod& mod) const;
+
+  /**
+   * @brief Find all workshop mods that contain resupply or ammo definitions
+   * @return Mods containing archives and loose files with resupply data, named after their
+   * workshop ID
+   */
+  std::vector<ModData> discoverMods() const;
+
+  /**
+   * @brief Add tasks patching resupply values of all mods found by discoverMods()
+   * @note Each mod is saved in a subdirectory named after its workshop ID
+   * @note An error while patching a mod is logged and does not stop the other mods
+   * @return Task that finishes after all files have been saved
    * @throw std::runtime_error
    */
-  void patchMod(const Mod& mod) const noexcept(false);
+  TaskGraph::TaskId patchDiscoveredMods(TaskGraph& graph) const noexcept(false);
 
   /**
-   * @brief Remove resupply restrictions for a mod
+   * @brief Add tasks removing resupply restrictions for a mod
+   * @param graph Graph to add the tasks to
+   * @param mod Mod to modify
+   * @param dependencies Tasks saving the patched files of the mod
+   * @return Task that finishes after all files have been saved
    * @note This function has not been tested for mods other than Valour
    */
-  void removeResupplyRestrictions(const Mod& mod) const;
+  TaskGraph::TaskId
+  removeResupplyRestrictions(TaskGraph& graph, const Mod& mod,
+                             const std::vector<TaskGraph::TaskId>& dependencies) const;
+
+  /**
+   * @brief Find entries of the game and workshop archives matching the provided pattern
+   * @param pattern Entry name pattern, e.g. "properties/resupply*.inc"
+   * @note Uses the archive index as of the last call to updateArchiveIndex()
+   */
+  std::vector<ArchiveIndex::Match> findInArchives(std::string_view pattern) const;
+
+  /**
+   * @brief Scan the game and workshop directories, only new or modified archives are read
+   */
+  void updateArchiveIndex();
 
 private:
+  // measures the private stages on generated data
+  friend class Benchmark;
+
   static constexpr size_t bufferSize = 1024 * 1024;
 
+  // patterns of files containing resupply data
+  static constexpr std::array resupplyPatterns = {"resupply*.inc", "ammo_*.inc"};
+
+  struct itemLists_t;
+
+  /**
+   * @brief Contents of an input file, either a memory mapping, a stored entry of a mapped archive
+   * or a buffer
+   */
+  struct fileData_t {
+    std::optional<MappedFile> mapping;
+    std::shared_ptr<const MappedArchive> archive;  // keeps the mapping of the entry alive
+    std::span<const char> entry;
+    std::vector<char> buffer;
+
+    std::span<const char> view() const noexcept {
+      if (mapping) {
+        return mapping->data();
+      }
+      return archive ? entry : std::span<const char>(buffer);
+    }
+  };
+
+  /**
+   * @brief Add tasks patching resupply values a mod and saving the files in the provided directory
+   * @param graph Graph to add the tasks to
+   * @param mod Mod to patch
+   * @param outputPath Output directory
+   */
+  TaskGraph::TaskId patchMod(TaskGraph& graph, const Mod& mod,
+                             const std::filesystem::path& outputPath) const;
+
   /**
    * @brief Extract a file from an archive
    * @param archiveFile Archive file to read
    * @param fileToExtract File to extract from inside the archive
    * @throw std::runtime_error
    */
-  static std::vector<char>
-  loadFromArchive(const std::filesystem::path& archiveFile,
-                  const std::filesystem::path& fileToExtract) noexcept(false);
+  fileData_t loadFromArchive(const std::filesystem::path& archiveFile,
+                             const std::filesystem::path& fileToExtract) const noexcept(false);
 
   /**
-   * @brief Read the specified file
-   * @param file File to read
+   * @brief Extract a file from a mapped archive, stored files refer to the mapping without a copy
+   * @param archive Mapped archive
+   * @param fileToExtract File to extract from inside the archive
+   * @param data Receives the file
+   * @return False if the file is missing or has to be extracted with libzip
+   * @throw std::runtime_error
+   */
+  bool loadFromMappedArchive(const std::shared_ptr<const MappedArchive>& archive,
+                             const std::filesystem::path& fileToExtract, fileData_t& data) const
+      noexcept(false);
+
+  /**
+   * @brief Extract a file from an archive using libzip
    * @throw std::runtime_error
    */
-  static std::vector<char> loadFromFile(const std::filesystem::path& file) noexcept(false);
+  std::vector<char> loadWithLibzip(const std::filesystem::path& archiveFile,
+                                   const std::filesystem::path& fileToExtract) const
+      noexcept(false);
 
   /**
-   * @brief Read a text file and store its contents in a string
+   * @brief Read the specified file, it is mapped into memory if possible
    * @param file File to read
-   * @return String containing the file contents
    * @throw std::runtime_error
    */
-  static std::string readFileToString(const std::filesystem::path& file) noexcept(false);
+  static fileData_t loadFromFile(const std::filesystem::path& file) noexcept(false);
 
   /**
    * @brief Patch resupply values of the provided data
    * @param data File data to patch
+   * @param settings Values to use
+   * @return Patched data
    * @throw std::runtime_error
    */
-  static void patch(std::vector<char>& data) noexcept(false);
+  static std::vector<char> patch(std::span<const char> data,
+                                 const Settings& settings) noexcept(false);
 
   /**
-   * @brief Save the provided data to the specified path
+   * @brief Save the provided data to the specified path, sharing the storage of an identical file
+   * if deduplication is enabled
    * @param data Data to save
    * @param file Output file
    * @throw std::runtime_error
    */
-  static void saveToFile(const std::vector<char>& data,
-                         const std::filesystem::path& file) noexcept(false);
+  void saveToFile(std::span<const char> data, const std::filesystem::path& file) const
+      noexcept(false);
 
   /**
    * @brief Get the game path
@@ -96,30 +242,112 @@ private:
   static std::filesystem::path getSteamPath() noexcept(false);
 
   /**
-   * @brief Extract a file from an archive, patch the resupply values, and save it in
-   * @link m_outputPath @endlink
+   * @brief Get the directory used to store persistent caches
+   */
+  static std::filesystem::path getCachePath() noexcept;
+
+  /**
+   * @brief Get the memory mapping of an archive, the archive is mapped again if it has changed
+   * @throw std::runtime_error
+   */
+  std::shared_ptr<const MappedArchive>
+  mappedArchive(const std::filesystem::path& archive) const noexcept(false);
+
+  /**
+   * @brief Add tasks extracting a file from an archive, patching the resupply values, and saving it
+   * in the provided path
+   * @param graph Graph to add the tasks to
    * @param archiveFile Archive to extract from
    * @param fileToExtract File to extract from inside the archive
-   * @throw std::runtime_error
+   * @param outputFile Output file path
+   * @return Task saving the file
+   */
+  TaskGraph::TaskId patchFileFromArchive(TaskGraph& graph, const std::filesystem::path& archiveFile,
+                                         const std::filesystem::path& fileToExtract,
+                                         const std::filesystem::path& outputFile) const
+      noexcept(false);
+
+  /**
+   * @brief Add tasks extracting files from an archive, patching the resupply values, and saving
+   * them in the provided directory
+   * @param graph Graph to add the tasks to
+   * @param archiveFile Archive to extract from
+   * @param files Files to extract from inside the archive
+   * @param outputPath Output directory
+   * @return Task that finishes after all files have been saved
    */
-  void patchFileFromArchive(const std::filesystem::path& archiveFile,
-                            const std::filesystem::path& fileToExtract) const noexcept(false);
+  TaskGraph::TaskId patchArchive(TaskGraph& graph, const std::filesystem::path& archiveFile,
+                                 std::span<const std::string_view> files,
+                                 const std::filesystem::path& outputPath) const noexcept(false);
 
   /**
-   * @brief Patch the resupply values of a file and save it in the provided path
+   * @brief Add tasks patching the resupply values of a file and saving it in the provided path
+   * @param graph Graph to add the tasks to
    * @param inputFile File to patch
    * @param outputFile Output file path
+   * @return Task saving the file
+   */
+  TaskGraph::TaskId patchFile(TaskGraph& graph, const std::filesystem::path& inputFile,
+                              const std::filesystem::path& outputFile) const noexcept(false);
+
+  /**
+   * @brief Add tasks patching and saving data once it has been loaded
+   *
+   * Together with the task loading the data, these are the stages of the pipeline, see TaskGraph.
+   * @param graph Graph to add the tasks to
+   * @param data Data filled by the task loading it
+   * @param outputFile Output file path
+   * @param loaded Task loading the data
+   * @return Task saving the file
+   */
+  TaskGraph::TaskId patchData(TaskGraph& graph, std::shared_ptr<fileData_t> data,
+                              const std::filesystem::path& outputFile,
+                              TaskGraph::TaskId loaded) const noexcept(false);
+
+  /**
+   * @brief Add tasks extracting item lists from the patched files of a mod into items_*_all.inc
+   * files and replacing them with includes
+   * @return Task that finishes after all files have been saved
+   */
+  TaskGraph::TaskId generateItemsAll(TaskGraph& graph, const Mod& mod,
+                                     const std::vector<TaskGraph::TaskId>& dependencies) const;
+
+  /**
+   * @brief Add tasks replacing the item lists of resupply definitions with the merged lists
+   * @return Task that finishes after all files have been saved
+   */
+  TaskGraph::TaskId replaceResupply(TaskGraph& graph, const Mod& mod,
+                                    const std::vector<TaskGraph::TaskId>& dependencies) const;
+
+  /**
+   * @brief Extract item lists from a file
+   * @param file File to read
+   * @param lists Lists to add the items to
+   * @throw std::runtime_error
+   */
+  void collectItems(const std::filesystem::path& file, itemLists_t& lists) const noexcept(false);
+
+  /**
+   * @brief Merge the items of a category, remove duplicates, and save them
+   * @param category Index of the item category
+   * @param lists Items of all files
+   * @param file Output file
    * @throw std::runtime_error
    */
-  void patchFile(const std::filesystem::path& inputFile,
-                 const std::filesystem::path& outputFile) const noexcept(false);
+  void saveItems(size_t category, std::span<const itemLists_t> lists,
+                 const std::filesystem::path& file) const noexcept(false);
 
   /**
-   * @brief Extract item lists from all files in the provided path and replace them with includes
+   * @brief Replace item lists in a file with includes of the merged lists
+   * @throw std::runtime_error
    */
-  void generateItemsAll(const Mod& mod) const;
+  void removeItems(const std::filesystem::path& file) const noexcept(false);
 
-  void replaceResupply(const Mod& mod) const;
+  /**
+   * @brief Replace item lists of resupply definitions in a file with the merged lists
+   * @throw std::runtime_error
+   */
+  void replaceResupply(const std::filesystem::path& file) const noexcept(false);
 
   /**
    * @brief Data structure representing a number inside a string.
@@ -135,7 +363,7 @@ private:
    * @param line The string to search for a number.
    * @throw std::runtime_error
    */
-  static data_t extractNumberFromString(const std::string& line) noexcept(false);
+  static data_t extractNumberFromString(std::string_view line) noexcept(false);
 
   /**
    * @brief Multiplies the first number inside a string with the given multiplier.
@@ -143,7 +371,7 @@ private:
    * @param multiplier Multiplier to use.
    * @throw std::runtime_error
    */
-  static void multiplyNumberInString(std::string& line, int multiplier) noexcept(false);
+  static void multiplyNumberInString(std::pmr::string& line, int multiplier) noexcept(false);
 
   /**
    * @brief Replaces the first number inside a string with the given value.
@@ -151,20 +379,51 @@ private:
    * @param newValue New value to use.
    * @throw std::runtime_error
    */
-  static void replaceNumberInString(std::string& line, int newValue) noexcept(false);
+  static void replaceNumberInString(std::pmr::string& line, int newValue) noexcept(false);
 
   /**
    * @brief Calculate the SHA256 sum of a file
    */
   static sha256sum sha256(const std::filesystem::path& file) noexcept(false);
 
-  static void ltrim(std::string& line) noexcept;
-  static void rtrim(std::string& line) noexcept;
-  static void trim(std::string& line) noexcept;
+  /**
+   * @brief Get the SHA256 sum of a file, it is only calculated if the file has changed
+   */
+  sha256sum cachedSha256(const std::filesystem::directory_entry& file) const noexcept(false);
+
+  static std::string_view ltrim(std::string_view line) noexcept;
+  static std::string_view rtrim(std::string_view line) noexcept;
+  static std::string_view trim(std::string_view line) noexcept;
 
   std::filesystem::path m_outputPath;
   std::filesystem::path m_gamePath;
   std::filesystem::path m_workshopPath;
 
   std::unordered_map<std::filesystem::path, sha256sum> m_outputChecksums;
+
+  struct checksum_t {
+    std::filesystem::file_time_type mtime;
+    uintmax_t size;
+    std::filesystem::file_time_type hashed;  // when the sum was calculated
+    sha256sum sum;
+  };
+
+  // checksums of all output files seen so far, by absolute path. They stay valid across output
+  // directories so daemon jobs only hash the files that have been written since.
+  mutable std::unordered_map<std::filesystem::path, checksum_t> m_checksumCache;
+
+  Settings m_settings;
+
+  unsigned m_jobs = TaskGraph::defaultJobs();
+
+  std::optional<FileDeduplicator> m_deduplicator;
+
+  ArchiveIndex m_archiveIndex;
+
+  EntryCache m_entryCache;
+
+  ZipHandlePool m_zipHandles;
+
+  mutable std::mutex m_mappedArchivesMutex;
+  mutable std::map<std::filesystem::path, std::shared_ptr<const MappedArchive>> m_mappedArchives;
 };
@@ -0,0 +1,178 @@
+#include "TaskGraph.h"
+
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include "Timer.h"
+
+using namespace std;
+
+TaskGraph::TaskId TaskGraph::add(std::string name, std::function<void()> function,
+                                 const std::vector<TaskId>& dependencies) {
+  const TaskId id = m_tasks.size();
+  m_tasks.push_back(
+      {std::move(name), std::move(function), {}, dependencies.size(), m_currentGroup});
+  for (const TaskId dependency : dependencies) {
+    m_tasks[dependency].dependents.push_back(id);
+  }
+  return id;
+}
+
+void TaskGraph::beginGroup(std::string name) {
+  m_currentGroup = m_groups.size();
+  m_groups.push_back(std::move(name));
+}
+
+void TaskGraph::endGroup() noexcept {
+  m_currentGroup = noGroup;
+}
+
+void TaskGraph::run(unsigned jobs) noexcept(false) {
+  Timer t(__FUNCTION__);
+  if (m_tasks.empty()) {
+    return;
+  }
+
+  jobs = max(1u, jobs);
+  spdlog::debug("running {} tasks with {} jobs", m_tasks.size(), jobs);
+
+  m_workers.clear();
+  for (unsigned i = 0; i < jobs; i++) {
+    m_workers.push_back(make_unique<worker_t>());
+  }
+  m_pendingDependencies = make_unique<atomic<size_t>[]>(m_tasks.size());
+  m_groupFailed         = make_unique<atomic<bool>[]>(m_groups.size());
+  m_remaining           = m_tasks.size();
+  m_failed              = false;
+  m_error               = nullptr;
+
+  // distribute tasks without dependencies
+  size_t worker = 0;
+  for (TaskId task = 0; task < m_tasks.size(); task++) {
+    m_pendingDependencies[task] = m_tasks[task].dependencyCount;
+    if (m_tasks[task].dependencyCount == 0) {
+      m_workers[worker++ % jobs]->queue.push_back(task);
+    }
+  }
+
+  {
+    vector<jthread> threads;
+    for (unsigned i = 1; i < jobs; i++) {
+      threads.emplace_back([this, i]() {
+        work(i);
+      });
+    }
+    work(0);
+  }
+
+  m_workers.clear();
+  m_pendingDependencies.reset();
+  m_groupFailed.reset();
+
+  if (m_error) {
+    rethrow_exception(m_error);
+  }
+}
+
+unsigned TaskGraph::defaultJobs() noexcept {
+  return max(1u, thread::hardware_concurrency());
+}
+
+void TaskGraph::work(size_t worker) {
+  for (;;) {
+    const size_t epoch = m_epoch.load(memory_order_acquire);
+
+    TaskId task;
+    if (next(worker, task)) {
+      execute(worker, task);
+      continue;
+    }
+    if (m_remaining.load(memory_order_acquire) == 0) {
+      return;
+    }
+
+    // wait until new tasks are ready or all tasks have been finished
+    m_epoch.wait(epoch, memory_order_acquire);
+  }
+}
+
+bool TaskGraph::next(size_t worker, TaskId& task) {
+  // newest task of the own queue
+  {
+    auto& own = *m_workers[worker];
+    lock_guard lock(own.mutex);
+    if (!own.queue.empty()) {
+      task = own.queue.back();
+      own.queue.pop_back();
+      return true;
+    }
+  }
+
+  // oldest task of another worker
+  for (size_t i = 1; i < m_workers.size(); i++) {
+    auto& victim = *m_workers[(worker + i) % m_workers.size()];
+    lock_guard lock(victim.mutex);
+    if (!victim.queue.empty()) {
+      task = victim.queue.front();
+      victim.queue.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void TaskGraph::push(size_t worker, TaskId task) {
+  {
+    auto& own = *m_workers[worker];
+    lock_guard lock(own.mutex);
+    own.queue.push_back(task);
+  }
+  m_epoch.fetch_add(1, memory_order_release);
+  m_epoch.notify_one();
+}
+
+void TaskGraph::execute(size_t worker, TaskId task) {
+  task_t& t = m_tasks[task];
+
+  const bool grouped = t.group != noGroup;
+  if (!m_failed.load(memory_order_relaxed) &&
+      !(grouped && m_groupFailed[t.group].load(memory_order_relaxed))) {
+    try {
+      try {
+        Timer timer(t.name);
+        t.function();
+      } catch (const runtime_error& e) {
+        if (!grouped) {
+          throw;
+        }
+        // only the first error of a group is reported, its other tasks are skipped
+        if (!m_groupFailed[t.group].exchange(true, memory_order_relaxed)) {
+          spdlog::error("{} failed: {}", m_groups[t.group], e.what());
+        }
+      }
+    } catch (...) {
+      lock_guard lock(m_errorMutex);
+      if (!m_error) {
+        m_error = current_exception();
+      }
+      m_failed = true;
+    }
+  }
+  // release captured data as early as possible
+  t.function = nullptr;
+
+  for (const TaskId dependent : t.dependents) {
+    if (m_pendingDependencies[dependent].fetch_sub(1, memory_order_acq_rel) == 1) {
+      push(worker, dependent);
+    }
+  }
+
+  if (m_remaining.fetch_sub(1, memory_order_acq_rel) == 1) {
+    m_epoch.fetch_add(1, memory_order_release);
+    m_epoch.notify_all();
+  }
+}
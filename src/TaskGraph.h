@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Graph of tasks with dependencies, executed by a work-stealing thread pool
+ *
+ * Each worker runs tasks from its own queue in LIFO order, so a task made ready by the task that
+ * just finished runs next on the same thread while its data is still hot. Idle workers steal the
+ * oldest task of another worker.
+ *
+ * The patcher uses chains of extract, patch and write tasks as its pipeline. Different workers are
+ * in different stages at the same time, so decompression, patching and disk I/O overlap. A worker
+ * finishes its chain before it takes the next extraction, which limits the buffers in flight to
+ * the number of jobs like the bounded queues of a dedicated pipeline would.
+ */
+class TaskGraph {
+public:
+  using TaskId = size_t;
+
+  /**
+   * @brief Add a task
+   * @param name Task name used for logging
+   * @param function Function to execute
+   * @param dependencies Tasks that have to be finished before this task can start
+   * @return ID of the new task
+   */
+  TaskId add(std::string name, std::function<void()> function,
+             const std::vector<TaskId>& dependencies = {});
+
+  /**
+   * @brief Start a group, the tasks added until endGroup() belong to it
+   *
+   * A std::runtime_error thrown by a task of a group is logged instead of stopping the graph. The
+   * remaining tasks of the group are skipped, all other tasks and the dependents of the group run
+   * normally.
+   * @param name Group name used for logging
+   */
+  void beginGroup(std::string name);
+
+  /**
+   * @brief End the current group, tasks added afterwards do not belong to any group
+   */
+  void endGroup() noexcept;
+
+  /**
+   * @brief Execute all tasks
+   * @param jobs Number of threads to use, including the calling thread
+   * @throw Rethrows the first exception thrown by a task. Tasks that have not been started yet are
+   * skipped after an error.
+   */
+  void run(unsigned jobs) noexcept(false);
+
+  /**
+   * @brief Default number of jobs, the number of available cores
+   */
+  static unsigned defaultJobs() noexcept;
+
+private:
+  static constexpr size_t noGroup = -1;
+
+  struct task_t {
+    std::string name;
+    std::function<void()> function;
+    std::vector<TaskId> dependents;
+    size_t dependencyCount = 0;
+    size_t group           = noGroup;
+  };
+
+  struct worker_t {
+    std::mutex mutex;
+    std::deque<TaskId> queue;
+  };
+
+  /**
+   * @brief Worker loop, returns when all tasks have been finished
+   */
+  void work(size_t worker);
+
+  /**
+   * @brief Get the next task, either from the worker's own queue or by stealing from other workers
+   * @return true if a task has been found
+   */
+  bool next(size_t worker, TaskId& task);
+
+  /**
+   * @brief Add a task that is ready to run to the queue of a worker
+   */
+  void push(size_t worker, TaskId task);
+
+  /**
+   * @brief Run a task and schedule all dependents that have become ready
+   */
+  void execute(size_t worker, TaskId task);
+
+  std::vector<task_t> m_tasks;
+  std::vector<std::string> m_groups;
+  size_t m_currentGroup = noGroup;
+
+  // state used while running
+  std::vector<std::unique_ptr<worker_t>> m_workers;
+  std::unique_ptr<std::atomic<size_t>[]> m_pendingDependencies;
+  std::atomic<size_t> m_remaining = 0;
+  std::atomic<size_t> m_epoch     = 0;  // incremented whenever new work is available
+  std::atomic<bool> m_failed      = false;
+  std::unique_ptr<std::atomic<bool>[]> m_groupFailed;
+  std::exception_ptr m_error;
+  std::mutex m_errorMutex;
+};
@@ -0,0 +1,203 @@
+#include "ZipDirectory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+constexpr uint32_t eocdSignature         = 0x06054b50;
+constexpr uint32_t zip64LocatorSignature = 0x07064b50;
+constexpr uint32_t zip64EocdSignature    = 0x06064b50;
+constexpr uint32_t fileHeaderSignature   = 0x02014b50;
+constexpr uint32_t localHeaderSignature  = 0x04034b50;
+
+constexpr size_t eocdSize         = 22;
+constexpr size_t zip64LocatorSize = 20;
+constexpr size_t zip64EocdSize    = 56;
+constexpr size_t fileHeaderSize   = 46;
+constexpr size_t localHeaderSize  = 30;
+constexpr size_t maxCommentSize   = 0xffff;
+
+constexpr uint16_t zip64ExtraId = 0x0001;
+
+template <typename T>
+T readLE(span<const char> data, size_t offset) noexcept(false) {
+  // offsets are read from the archive, offset + sizeof(T) could overflow
+  if (offset > data.size() || sizeof(T) > data.size() - offset) {
+    throw runtime_error("unexpected end of zip data");
+  }
+  T value = 0;
+  for (size_t i = 0; i < sizeof(T); i++) {
+    value |= static_cast<T>(static_cast<unsigned char>(data[offset + i])) << (8 * i);
+  }
+  return value;
+}
+}  // namespace
+
+std::vector<ZipDirectory::Entry>
+ZipDirectory::read(const std::filesystem::path& archive) noexcept(false) {
+  ifstream in(archive, ios::binary);
+  if (!in) {
+    throw runtime_error("failed to open " + archive.string());
+  }
+  in.exceptions(ios::failbit | ios::badbit);
+
+  auto readAt = [&in](uint64_t offset, uint64_t size) {
+    vector<char> data(size);
+    in.seekg(static_cast<streamoff>(offset));
+    in.read(data.data(), static_cast<streamsize>(size));
+    return data;
+  };
+
+  const uint64_t fileSize   = fs::file_size(archive);
+  const uint64_t tailSize   = min<uint64_t>(fileSize, eocdSize + maxCommentSize);
+  const uint64_t tailOffset = fileSize - tailSize;
+  const vector<char> tail   = readAt(tailOffset, tailSize);
+
+  const location_t location = locate(tail, readAt);
+  if (location.offset > fileSize || location.size > fileSize - location.offset) {
+    throw runtime_error("invalid central directory in " + archive.string());
+  }
+
+  return parseEntries(readAt(location.offset, location.size), location.entries);
+}
+
+std::vector<ZipDirectory::Entry>
+ZipDirectory::parse(std::span<const char> archive) noexcept(false) {
+  auto readAt = [archive](uint64_t offset, uint64_t size) {
+    if (offset > archive.size() || size > archive.size() - offset) {
+      throw runtime_error("unexpected end of zip data");
+    }
+    return archive.subspan(offset, size);
+  };
+
+  const location_t location = locate(archive, readAt);
+  return parseEntries(readAt(location.offset, location.size), location.entries);
+}
+
+template <typename F>
+ZipDirectory::location_t ZipDirectory::locate(std::span<const char> tail,
+                                              F&& readAt) noexcept(false) {
+  if (tail.size() < eocdSize) {
+    throw runtime_error("file is too small to be a zip archive");
+  }
+
+  // search backwards, the record is followed by a comment of variable length
+  size_t eocd = tail.size() - eocdSize + 1;
+  do {
+    eocd--;
+    if (readLE<uint32_t>(tail, eocd) == eocdSignature) {
+      break;
+    }
+  } while (eocd > 0);
+  if (readLE<uint32_t>(tail, eocd) != eocdSignature) {
+    throw runtime_error("end of central directory not found");
+  }
+
+  location_t location{
+      .offset  = readLE<uint32_t>(tail, eocd + 16),
+      .size    = readLE<uint32_t>(tail, eocd + 12),
+      .entries = readLE<uint16_t>(tail, eocd + 10),
+  };
+
+  // zip64 archives store the actual values in a separate record
+  if (eocd >= zip64LocatorSize &&
+      readLE<uint32_t>(tail, eocd - zip64LocatorSize) == zip64LocatorSignature) {
+    const auto recordOffset = readLE<uint64_t>(tail, eocd - zip64LocatorSize + 8);
+    const auto record       = readAt(recordOffset, zip64EocdSize);
+    const span<const char> data(record);
+
+    if (readLE<uint32_t>(data, 0) != zip64EocdSignature) {
+      throw runtime_error("invalid zip64 end of central directory");
+    }
+    location.entries = readLE<uint64_t>(data, 32);
+    location.size    = readLE<uint64_t>(data, 40);
+    location.offset  = readLE<uint64_t>(data, 48);
+  }
+
+  return location;
+}
+
+std::vector<ZipDirectory::Entry> ZipDirectory::parseEntries(std::span<const char> directory,
+                                                            uint64_t entries) noexcept(false) {
+  // every record takes at least fileHeaderSize bytes, a larger count would make reserve() fail
+  if (entries > directory.size() / fileHeaderSize) {
+    throw runtime_error("central directory is too small for " + to_string(entries) + " entries");
+  }
+
+  vector<Entry> result;
+  result.reserve(entries);
+
+  size_t pos = 0;
+  for (uint64_t i = 0; i < entries; i++) {
+    if (readLE<uint32_t>(directory, pos) != fileHeaderSignature) {
+      throw runtime_error("invalid central directory file header");
+    }
+
+    Entry entry{
+        .name             = {},
+        .offset           = readLE<uint32_t>(directory, pos + 42),
+        .compressedSize   = readLE<uint32_t>(directory, pos + 20),
+        .uncompressedSize = readLE<uint32_t>(directory, pos + 24),
+        .crc              = readLE<uint32_t>(directory, pos + 16),
+        .method           = readLE<uint16_t>(directory, pos + 10),
+        .flags            = readLE<uint16_t>(directory, pos + 8),
+    };
+
+    const size_t nameLength    = readLE<uint16_t>(directory, pos + 28);
+    const size_t extraLength   = readLE<uint16_t>(directory, pos + 30);
+    const size_t commentLength = readLE<uint16_t>(directory, pos + 32);
+    const size_t nameOffset    = pos + fileHeaderSize;
+
+    if (nameOffset > directory.size() ||
+        nameLength + extraLength > directory.size() - nameOffset) {
+      throw runtime_error("unexpected end of central directory");
+    }
+    entry.name.assign(directory.data() + nameOffset, nameLength);
+
+    // values that do not fit into 32 bits are stored in the zip64 extra field
+    span<const char> extra = directory.subspan(nameOffset + nameLength, extraLength);
+    for (size_t e = 0; e + 4 <= extra.size();) {
+      const auto id   = readLE<uint16_t>(extra, e);
+      const auto size = readLE<uint16_t>(extra, e + 2);
+      if (id == zip64ExtraId) {
+        span<const char> field = extra.subspan(e + 4, min<size_t>(size, extra.size() - e - 4));
+        size_t f               = 0;
+        for (uint64_t* value : {&entry.uncompressedSize, &entry.compressedSize, &entry.offset}) {
+          if (*value == 0xffffffff) {
+            *value = readLE<uint64_t>(field, f);
+            f += 8;
+          }
+        }
+        break;
+      }
+      e += 4 + size;
+    }
+
+    result.push_back(std::move(entry));
+    pos = nameOffset + nameLength + extraLength + commentLength;
+  }
+
+  return result;
+}
+
+std::span<const char> ZipDirectory::entryData(std::span<const char> archive,
+                                              const Entry& entry) noexcept(false) {
+  if (readLE<uint32_t>(archive, entry.offset) != localHeaderSignature) {
+    throw runtime_error("invalid local file header of " + entry.name);
+  }
+  // the extra field of the local header can differ from the one in the central directory
+  const auto nameLength  = readLE<uint16_t>(archive, entry.offset + 26);
+  const auto extraLength = readLE<uint16_t>(archive, entry.offset + 28);
+
+  const uint64_t dataOffset = entry.offset + localHeaderSize + nameLength + extraLength;
+  if (dataOffset > archive.size() || entry.compressedSize > archive.size() - dataOffset) {
+    throw runtime_error("unexpected end of zip data in " + entry.name);
+  }
+  return archive.subspan(dataOffset, entry.compressedSize);
+}
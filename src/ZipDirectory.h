@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Minimal reader for the central directory of zip archives
+ *
+ * Only the central directory is parsed, which makes it possible to list the contents of an
+ * archive without opening it with libzip.
+ */
+class ZipDirectory {
+public:
+  struct Entry {
+    std::string name;
+    uint64_t offset;            //! offset of the local file header
+    uint64_t compressedSize;    //! compressed size
+    uint64_t uncompressedSize;  //! uncompressed size
+    uint32_t crc;               //! CRC32 of the uncompressed data
+    uint16_t method;            //! compression method
+    uint16_t flags;             //! general purpose bit flags
+  };
+
+  /**
+   * @brief Read the central directory of an archive file
+   * @param archive Archive to read
+   * @throw std::runtime_error
+   */
+  static std::vector<Entry> read(const std::filesystem::path& archive) noexcept(false);
+
+  /**
+   * @brief Parse the central directory of an archive stored in memory
+   * @param archive Complete archive contents
+   * @throw std::runtime_error
+   */
+  static std::vector<Entry> parse(std::span<const char> archive) noexcept(false);
+
+  /**
+   * @brief Get the data of an entry, following its local file header
+   * @param archive Complete archive contents
+   * @param entry Entry of the archive
+   * @return Data as stored in the archive, compressed with the entry's method
+   * @throw std::runtime_error
+   */
+  static std::span<const char> entryData(std::span<const char> archive,
+                                         const Entry& entry) noexcept(false);
+
+private:
+  struct location_t {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t entries;
+  };
+
+  /**
+   * @brief Find the central directory using the end of central directory record
+   * @param tail End of the archive, has to contain the end of central directory record
+   * @param readAt Function used to read data outside the tail, e.g. the zip64 record
+   * @throw std::runtime_error
+   */
+  template <typename F>
+  static location_t locate(std::span<const char> tail, F&& readAt) noexcept(false);
+
+  /**
+   * @brief Parse central directory file headers
+   * @throw std::runtime_error
+   */
+  static std::vector<Entry> parseEntries(std::span<const char> directory,
+                                         uint64_t entries) noexcept(false);
+};
@@ -0,0 +1,86 @@
+#include "ZipHandlePool.h"
+
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+ZipHandlePool::Handle::Handle(const ZipHandlePool& pool, std::filesystem::path archive,
+                              uint64_t generation, zip_t* handle) noexcept
+    : m_pool(&pool), m_archive(std::move(archive)), m_generation(generation), m_handle(handle) {}
+
+ZipHandlePool::Handle::Handle(Handle&& other) noexcept
+    : m_pool(other.m_pool), m_archive(std::move(other.m_archive)),
+      m_generation(other.m_generation), m_handle(exchange(other.m_handle, nullptr)) {}
+
+ZipHandlePool::Handle::~Handle() {
+  if (m_handle != nullptr) {
+    m_pool->release(m_archive, m_generation, m_handle);
+  }
+}
+
+ZipHandlePool::~ZipHandlePool() {
+  for (auto& archive : m_archives | views::values) {
+    for (zip_t* handle : archive.idle) {
+      zip_discard(handle);
+    }
+  }
+}
+
+ZipHandlePool::Handle ZipHandlePool::acquire(const std::filesystem::path& archive) const
+    noexcept(false) {
+  error_code ec;
+  const auto mtime = fs::last_write_time(archive, ec);
+  const auto size  = ec ? 0 : fs::file_size(archive, ec);
+
+  uint64_t generation;
+  {
+    lock_guard lock(m_mutex);
+    archive_t& entry = m_archives[archive];
+    if (ec || entry.mtime != mtime || entry.size != size) {
+      // the archive has changed, handles opened before would read inconsistent data
+      for (zip_t* handle : entry.idle) {
+        zip_discard(handle);
+      }
+      entry = {mtime, size, entry.generation + 1, {}};
+    } else if (!entry.idle.empty()) {
+      zip_t* handle = entry.idle.back();
+      entry.idle.pop_back();
+      return {*this, archive, entry.generation, handle};
+    }
+    generation = entry.generation;
+  }
+
+  // opening reads the central directory, which is done without holding the lock
+  int err;
+  zip_t* handle = zip_open(archive.c_str(), ZIP_RDONLY, &err);
+  if (handle == nullptr) {
+    zip_error_t error;
+    zip_error_init_with_code(&error, err);
+
+    const string errorString = "error opening archive: "s + zip_error_strerror(&error);
+
+    zip_error_fini(&error);
+
+    throw runtime_error(errorString);
+  }
+  return {*this, archive, generation, handle};
+}
+
+void ZipHandlePool::release(const std::filesystem::path& archive, uint64_t generation,
+                            zip_t* handle) const noexcept {
+  // the error of a failed call stays in the handle, the next user would report it
+  zip_error_clear(handle);
+
+  lock_guard lock(m_mutex);
+  archive_t& entry = m_archives[archive];
+  if (entry.generation != generation) {
+    zip_discard(handle);
+    return;
+  }
+  entry.idle.push_back(handle);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <zip.h>
+
+/**
+ * @brief Open libzip handles of archives, reused by later extractions
+ *
+ * libzip handles are not thread-safe, so every thread extracting from an archive borrows a handle
+ * of its own. Different entries of an archive can therefore be decompressed concurrently without
+ * opening the archive and reading its central directory for every entry. The idle handles of an
+ * archive are closed when its modification time or size changes.
+ */
+class ZipHandlePool {
+public:
+  /**
+   * @brief Handle borrowed from the pool, it is returned when this object is destroyed
+   */
+  class Handle {
+  public:
+    Handle(Handle&& other) noexcept;
+    Handle& operator=(Handle&&) = delete;
+    Handle(const Handle&)       = delete;
+    ~Handle();
+
+    zip_t* get() const noexcept { return m_handle; }
+
+  private:
+    friend class ZipHandlePool;
+    Handle(const ZipHandlePool& pool, std::filesystem::path archive, uint64_t generation,
+           zip_t* handle) noexcept;
+
+    const ZipHandlePool* m_pool;
+    std::filesystem::path m_archive;
+    uint64_t m_generation;
+    zip_t* m_handle;
+  };
+
+  ZipHandlePool() = default;
+  ~ZipHandlePool();
+
+  ZipHandlePool(const ZipHandlePool&)            = delete;
+  ZipHandlePool& operator=(const ZipHandlePool&) = delete;
+
+  /**
+   * @brief Borrow a handle of an archive, the archive is opened if no handle is idle
+   * @throw std::runtime_error If the archive cannot be opened
+   */
+  Handle acquire(const std::filesystem::path& archive) const noexcept(false);
+
+private:
+  struct archive_t {
+    std::filesystem::file_time_type mtime;
+    uintmax_t size      = 0;
+    uint64_t generation = 0;  //! incremented whenever the archive has changed
+    std::vector<zip_t*> idle;
+  };
+
+  /**
+   * @brief Return a handle, its error state is cleared. It is closed if the archive has changed
+   * since it has been opened.
+   */
+  void release(const std::filesystem::path& archive, uint64_t generation,
+               zip_t* handle) const noexcept;
+
+  mutable std::mutex m_mutex;
+  mutable std::map<std::filesystem::path, archive_t> m_archives;
+};
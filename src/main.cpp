@@ -2,12 +2,19 @@
 #include <exception>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 #include <stdexcept>
 #include <string>
 
+#include "AsyncLogger.h"
+#include "Daemon.h"
+#include "Jobs.h"
 #include "Mods.h"
 #include "Patcher.h"
+#include "TaskGraph.h"
 #include "spdlog/common.h"
 
 using namespace std;
@@ -41,49 +48,118 @@ int main(int argc, char** argv) {
       .help("increase output verbosity")
       .flag();
 
+  // every supported mod gets a flag named after its option, and its short option if it has one
   auto& modGroup = program.add_mutually_exclusive_group();
-  modGroup.add_argument("-V", "--valour").help("patch valour").flag();
-  modGroup.add_argument("-H", "--hotmod").help("patch hotmod").flag();
-  modGroup.add_argument("-W", "--west81").help("patch west81").flag();
-  modGroup.add_argument("-M", "--mace").help("patch mace").flag();
-  modGroup.add_argument("-hf", "--hortens-frontline").help("patch hortens frontline").flag();
+  for (const Mod& mod : mods::registry) {
+    const string option = "--" + string(mod.option);
+    auto& argument      = mod.shortOption.empty()
+                              ? modGroup.add_argument(option)
+                              : modGroup.add_argument("-" + string(mod.shortOption), option);
+    argument.help("patch " + string(mod.name)).flag();
+  }
+  modGroup.add_argument("-D", "--discover")
+      .help("patch all workshop mods containing resupply data")
+      .flag();
+
+  program.add_argument("-f", "--find")
+      .help("list archive entries matching a pattern, e.g. 'properties/resupply*.inc'")
+      .metavar("PATTERN");
+
+  program.add_argument("-j", "--jobs")
+      .help("number of threads to use")
+      .default_value(TaskGraph::defaultJobs())
+      .scan<'u', unsigned>();
+
+  program.add_argument("--cache-size")
+      .help("size limit of the cache of extracted files in MiB, 0 disables the cache")
+      .default_value(static_cast<unsigned>(Patcher::defaultCacheSize / (1024 * 1024)))
+      .scan<'u', unsigned>()
+      .metavar("MIB");
+
+  program.add_argument("--dedup")
+      .help("share the storage of identical output files using reflinks or hard links")
+      .flag();
+
+  program.add_argument("--daemon")
+      .help("serve patch jobs on a Unix domain socket, the output directory is used by default")
+      .metavar("SOCKET");
 
-  program.add_argument("out").help("output directory").required();
+  // listing archive entries does not write anything
+  program.add_argument("out")
+      .help("output directory, not needed with --find")
+      .nargs(argparse::nargs_pattern::optional);
 
   try {
     program.parse_args(argc, argv);
+    if (!program.present("out") && !program.present("--find")) {
+      throw runtime_error("out: the output directory is required");
+    }
   } catch (const exception& err) {
     cerr << err.what() << "\n";
     cerr << program;
     return 1;
   }
 
-  spdlog::set_level(verbosityToLogLevel(verbosity));
+  const spdlog::level::level_enum logLevel = verbosityToLogLevel(verbosity);
+  spdlog::set_level(logLevel);
+
+  // debug and trace messages are written on a background thread
+  optional<AsyncLogger> asyncLogger;
+  if (logLevel <= spdlog::level::debug) {
+    asyncLogger.emplace(make_shared<spdlog::sinks::stdout_color_sink_mt>(), logLevel);
+  }
+
+  fs::path outDir = program.present("out").value_or("");
 
-  fs::path outDir = program.get<string>("out");
-  Patcher p(outDir);
+  Patcher p(outDir, uint64_t{program.get<unsigned>("--cache-size")} * 1024 * 1024);
+  p.setDeduplication(program.get<bool>("--dedup"));
+  p.setJobs(program.get<unsigned>("--jobs"));
+
+  if (auto socket = program.present("--daemon")) {
+    try {
+      Daemon(p, *socket, program.get<unsigned>("--jobs")).run();
+    } catch (const runtime_error& ex) {
+      cerr << "Error in daemon: " << ex.what() << "\n";
+      return 1;
+    }
+    return 0;
+  }
 
   try {
-    if (program.is_used("--valour")) {
-      p.patchMod(mods::Valour);
-      p.removeResupplyRestrictions(mods::Valour);
-    } else if (program.is_used("--hotmod")) {
-      p.patchVanilla();  // hotmod 1968 does not overwrite the original "resupply.inc"
-      p.patchMod(mods::Hotmod);
-    } else if (program.is_used("--west81")) {
-      // todo: check if `resupply.inc` even gets loaded as mod contains `resuppply_vanilla.inc`
-      p.patchVanilla();  // west 81 does not overwrite the original "resupply.inc"
-      p.patchMod(mods::West81);
-    } else if (program.is_used("--mace")) {
-      p.patchMod(mods::Mace);
-    } else if (program.is_used("--hortens-frontline")) {
-      p.patchMod(mods::HortensFrontline);
-    } else {
-      p.patchVanilla();
+    if (auto pattern = program.present("--find")) {
+      p.updateArchiveIndex();
+      for (const auto& [archive, entry] : p.findInArchives(*pattern)) {
+        cout << archive.string() << ": " << entry.name << " (" << entry.uncompressedSize
+             << " bytes)\n";
+      }
+      return 0;
     }
+
+    string job = "vanilla";
+    for (const string_view name : jobNames) {
+      if (name != "vanilla" && program.is_used("--" + string(name))) {
+        job = name;
+      }
+    }
+
+    // only discovering mods searches the archive index
+    if (job == "discover") {
+      p.updateArchiveIndex();
+    }
+
+    TaskGraph graph;
+    addJob(p, graph, job);
+    graph.run(program.get<unsigned>("--jobs"));
   } catch (const runtime_error& ex) {
     cerr << "Error while patching: " << ex.what() << "\n";
   }
 
+  // print the queued messages first
+  asyncLogger.reset();
+
+  for (const auto& file : p.changedFiles()) {
+    cout << "\033[33m" << "contents of " << (outDir / file).string() << " have changed\033[0m\n";
+  }
+
   return 0;
 }
@@ -2,9 +2,14 @@
 
 #include "Mod.h"
 
+namespace mods {
 /**
  * Horten's Frontline
  * https://steamcommunity.com/sharedfiles/filedetails/?id=3359417100
  */
-MOD(HortensFrontline, 3359417100)
-MOD_ARCHIVES(HortensFrontline, "properties/resupply.inc")
+inline constexpr ModDefinition HortensFrontline{"HortensFrontline", "hortens-frontline", "hf",
+                                                "3359417100",
+                                                {
+                                                    {"", "properties/resupply.inc"},
+                                                }};
+}  // namespace mods
@@ -2,12 +2,16 @@
 
 #include "Mod.h"
 
+namespace mods {
 /**
  * Hotmod 1968
  * https://steamcommunity.com/sharedfiles/filedetails/?id=2614199156
  */
-MOD(Hotmod, 2614199156)
-MOD_ARCHIVES(Hotmod, Archive{
-                         "gamelogic.pak", std::vector{"properties/resupply_hotmod.inc",
-                                                      "properties/resupply_vanilla.inc"}
-})
+// hotmod 1968 does not overwrite the original "resupply.inc"
+inline constexpr ModDefinition Hotmod{"Hotmod", "hotmod", "H", "2614199156",
+                                      {
+                                          {"gamelogic.pak", "properties/resupply_hotmod.inc"},
+                                          {"gamelogic.pak", "properties/resupply_vanilla.inc"},
+                                      },
+                                      PostPass::patchVanilla};
+}  // namespace mods
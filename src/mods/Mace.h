@@ -2,9 +2,13 @@
 
 #include "Mod.h"
 
+namespace mods {
 /**
  * MACE
  * https://steamcommunity.com/sharedfiles/filedetails/?id=2905667604
  */
-MOD(Mace, 2905667604)
-MOD_ARCHIVES(Mace, Archive{"properties.pak", "properties/resupply.inc"})
+inline constexpr ModDefinition Mace{"Mace", "mace", "M", "2905667604",
+                                    {
+                                        {"properties.pak", "properties/resupply.inc"},
+                                    }};
+}  // namespace mods
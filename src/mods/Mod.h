@@ -1,75 +1,190 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <map>
+#include <ranges>
+#include <span>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
+/**
+ * @brief Passes applied after the files of a mod have been patched
+ */
+enum class PostPass : unsigned {
+  none = 0,
+  //! the mod does not overwrite the original "resupply.inc", it is patched as well
+  patchVanilla = 1 << 0,
+  //! merge the item lists of the mod, see Patcher::removeResupplyRestrictions()
+  removeResupplyRestrictions = 1 << 1,
+};
+
+constexpr PostPass operator|(PostPass lhs, PostPass rhs) noexcept {
+  return static_cast<PostPass>(static_cast<unsigned>(lhs) | static_cast<unsigned>(rhs));
+}
+
+constexpr bool contains(PostPass passes, PostPass pass) noexcept {
+  return (static_cast<unsigned>(passes) & static_cast<unsigned>(pass)) != 0;
+}
+
+/**
+ * @brief Files to patch inside a single archive
+ */
 struct Archive {
-  Archive(const char* archive, const char* file) : archive(archive), files(std::vector{file}) {}
-  Archive(const char* archive, std::vector<const char*> files)
-      : archive(archive), files(std::move(files)) {}
-  Archive() = delete;
+  std::string_view archive;                 //! archive file name
+  std::span<const std::string_view> files;  //! files to patch inside the archive
+};
 
-  const char* const archive;             //! archive file name
-  const std::vector<const char*> files;  //! files to patch inside the archive
+/**
+ * @brief Files of a mod that should be patched, grouped by archive so every archive is opened once
+ *
+ * Mods only refer to their data, which is either a ModDefinition or a ModData.
+ */
+struct Mod {
+  std::string_view name;                    //! mod name
+  std::string_view option;                  //! command line option and daemon job name
+  std::string_view shortOption;             //! short command line option, may be empty
+  std::string_view workshopID;              //! Steam Workshop ID, used to find the mod
+  std::span<const Archive> archives;        //! archives containing files that should be patched
+  std::span<const std::string_view> files;  //! loose files relative to the resource directory
+  PostPass passes = PostPass::none;
+};
+
+/**
+ * @brief Check that no two files of a mod are written to the same output path
+ */
+constexpr bool hasUniquePaths(const Mod& mod) noexcept {
+  std::vector<std::string_view> paths(mod.files.begin(), mod.files.end());
+  for (const auto& archive : mod.archives) {
+    paths.insert(paths.end(), archive.files.begin(), archive.files.end());
+  }
+  std::ranges::sort(paths);
+  return std::ranges::adjacent_find(paths) == paths.end();
+}
+
+/**
+ * @brief File that should be patched
+ */
+struct ModFile {
+  std::string_view archive;  //! archive file name, empty for loose files
+  std::string_view path;     //! path inside the archive or relative to the resource directory
 };
 
 /**
- * @brief Base class for mods
+ * @brief Mod declared at compile time, the extraction plan is computed by the compiler
+ *
+ * Files of the same archive are grouped in the order of their first appearance, followed by the
+ * loose files. The mod refers to the definition, which must therefore not be copied.
+ * @tparam N Number of files
  */
-class Mod {
+template <size_t N>
+class ModDefinition {
 public:
   /**
    * @param name Mod name
-   * @param archives Files that should be patched.
+   * @param option Command line option and daemon job name
+   * @param shortOption Short command line option without the dash
    * @param workshopID Steam Workshop ID of the mod. Required to automatically detect the mod path.
+   * @param files Files that should be patched
+   * @param passes Passes to apply afterwards
    */
-  Mod(std::string name, std::vector<Archive> archives, const char* workshopID)
-      : name(std::move(name)), archives(std::move(archives)), workshopID(workshopID) {}
+  consteval ModDefinition(std::string_view name, std::string_view option,
+                          std::string_view shortOption, std::string_view workshopID,
+                          const ModFile (&files)[N], PostPass passes = PostPass::none)
+      : m_mod{name, option, shortOption, workshopID, {}, {}, passes} {
+    size_t count = 0;
+    for (size_t i = 0; i < N; i++) {
+      if (files[i].archive.empty() || isGrouped(files, i)) {
+        continue;
+      }
+      const size_t first = count;
+      for (size_t j = i; j < N; j++) {
+        if (files[j].archive == files[i].archive) {
+          m_paths[count++] = files[j].path;
+        }
+      }
+      m_archives[m_archiveCount++] = {files[i].archive, {m_paths.data() + first, count - first}};
+    }
 
-  Mod(std::string name, std::vector<std::filesystem::path> files, const char* workshopID)
-      : name(std::move(name)), files(std::move(files)), workshopID(workshopID) {}
+    const size_t firstLoose = count;
+    for (size_t i = 0; i < N; i++) {
+      if (files[i].archive.empty()) {
+        m_paths[count++] = files[i].path;
+      }
+    }
 
-  /**
-   * @param name Mod name
-   * @param archive File that should be patched.
-   * @param workshopID Steam Workshop ID of the mod. Required to automatically detect the mod path.
-   */
-  Mod(std::string name, Archive archive, const char* workshopID)
-      : name(std::move(name)), archives(std::vector{std::move(archive)}), workshopID(workshopID) {}
+    m_mod.archives = {m_archives.data(), m_archiveCount};
+    m_mod.files    = {m_paths.data() + firstLoose, N - firstLoose};
+  }
 
-  Mod(std::string name, std::filesystem::path file, const char* workshopID)
-      : name(std::move(name)), files(std::vector{std::move(file)}), workshopID(workshopID) {}
+  ModDefinition(const ModDefinition&)            = delete;
+  ModDefinition& operator=(const ModDefinition&) = delete;
 
-  Mod() = delete;
+  constexpr const Mod& mod() const noexcept { return m_mod; }
 
-  const std::string name;
-  const std::vector<Archive> archives;
-  const std::vector<std::filesystem::path> files;
-  const char* const workshopID;
+private:
+  // whether the archive of a file has been grouped with an earlier file
+  static consteval bool isGrouped(const ModFile (&files)[N], size_t index) {
+    for (size_t i = 0; i < index; i++) {
+      if (files[i].archive == files[index].archive) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::array<std::string_view, N> m_paths{};
+  std::array<Archive, N> m_archives{};
+  size_t m_archiveCount = 0;
+  Mod m_mod;
 };
 
 /**
- * @brief Define a new mod
- * @param name Mod name
- * @param id Steam Workshop ID
+ * @brief Mod created at runtime, e.g. by discovering workshop mods
  */
-#define MOD(name, id)                                                                              \
-  class Mod##name : public Mod {                                                                   \
-  public:                                                                                          \
-    explicit Mod##name(std::vector<Archive> archives) : Mod(#name, std::move(archives), #id) {}    \
-    explicit Mod##name(std::vector<std::filesystem::path> files)                                   \
-        : Mod(#name, std::move(files), #id) {}                                                     \
-    explicit Mod##name(Archive archive) : Mod(#name, std::move(archive), #id) {}                   \
-    explicit Mod##name(std::filesystem::path file) : Mod(#name, std::move(file), #id) {}           \
-  };
+class ModData {
+public:
+  /**
+   * @param name Mod name
+   * @param workshopID Steam Workshop ID of the mod
+   * @param archives Files to patch by archive
+   * @param files Loose files that should be patched
+   */
+  ModData(std::string name, std::string workshopID,
+          const std::map<std::string, std::vector<std::string>>& archives,
+          const std::vector<std::string>& files)
+      : m_strings{std::move(name), std::move(workshopID)} {
+    for (const auto& [archive, entries] : archives) {
+      m_strings.push_back(archive);
+      m_strings.insert(m_strings.end(), entries.begin(), entries.end());
+    }
+    m_strings.insert(m_strings.end(), files.begin(), files.end());
 
-/**
- * @brief Define mod archives containing resupply data
- * @param name Mod name
- * @param ... Archive list. Can be either archive{} or std::vector<archive>{}
- */
-#define MOD_ARCHIVES(name, ...)                                                                    \
-  namespace mods {                                                                                 \
-    static const Mod##name name{__VA_ARGS__};                                                      \
+    // the views refer to the elements of m_strings, which stay in place when the object is moved
+    m_views.assign(m_strings.begin(), m_strings.end());
+    const std::span<const std::string_view> names = m_views;
+    size_t offset                                 = 2;
+    for (const auto& entries : archives | std::views::values) {
+      m_archives.push_back({names[offset], names.subspan(offset + 1, entries.size())});
+      offset += entries.size() + 1;
+    }
+
+    m_mod = {names[0], names[0], {}, names[1], m_archives, names.subspan(offset)};
   }
+
+  ModData(ModData&&) noexcept            = default;
+  ModData& operator=(ModData&&) noexcept = default;
+  ModData(const ModData&)                = delete;
+  ModData& operator=(const ModData&)     = delete;
+
+  const Mod& mod() const noexcept { return m_mod; }
+
+private:
+  std::vector<std::string> m_strings;  // name, workshop ID, archives followed by their files
+  std::vector<std::string_view> m_views;
+  std::vector<Archive> m_archives;
+  Mod m_mod;
+};
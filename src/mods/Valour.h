@@ -2,18 +2,21 @@
 
 #include "Mod.h"
 
+namespace mods {
 /**
  * valour
  * https://steamcommunity.com/sharedfiles/filedetails/?id=2537987794
  */
-MOD(Valour, 2537987794)
-MOD_ARCHIVES(Valour, std::vector<Archive>{
-                         {"britain.pak", "properties/ammo_eng.inc"},
-                         {    "fra.pak", "properties/ammo_fra.inc"},
-                         {    "hun.pak", "properties/ammo_hun.inc"},
-                         {    "ita.pak", "properties/ammo_ita.inc"},
-                         {    "jap.pak", "properties/ammo_jap.inc"},
-                         {    "pol.pak", "properties/ammo_pol.inc"},
-                         {   "usaf.pak", "properties/ammo_usa.inc"},
-                         {"general.pak", "properties/resupply.inc"}
-})
+inline constexpr ModDefinition Valour{"Valour", "valour", "V", "2537987794",
+                                      {
+                                          {"britain.pak", "properties/ammo_eng.inc"},
+                                          {    "fra.pak", "properties/ammo_fra.inc"},
+                                          {    "hun.pak", "properties/ammo_hun.inc"},
+                                          {    "ita.pak", "properties/ammo_ita.inc"},
+                                          {    "jap.pak", "properties/ammo_jap.inc"},
+                                          {    "pol.pak", "properties/ammo_pol.inc"},
+                                          {   "usaf.pak", "properties/ammo_usa.inc"},
+                                          {"general.pak", "properties/resupply.inc"},
+                                      },
+                                      PostPass::removeResupplyRestrictions};
+}  // namespace mods
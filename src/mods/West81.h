@@ -2,12 +2,17 @@
 
 #include "Mod.h"
 
+namespace mods {
 /**
  * west 81
  * https://steamcommunity.com/sharedfiles/filedetails/?id=2897299509
  */
-MOD(West81, 2897299509)
-MOD_ARCHIVES(West81, Archive{
-                         "engine.pak",
-                         {"properties/resupply_hotmod.inc", "properties/resupply_vanilla.inc"}
-})
+// todo: check if `resupply.inc` even gets loaded as mod contains `resuppply_vanilla.inc`
+// west 81 does not overwrite the original "resupply.inc"
+inline constexpr ModDefinition West81{"West81", "west81", "W", "2897299509",
+                                      {
+                                          {"engine.pak", "properties/resupply_hotmod.inc"},
+                                          {"engine.pak", "properties/resupply_vanilla.inc"},
+                                      },
+                                      PostPass::patchVanilla};
+}  // namespace mods